@@ -0,0 +1,386 @@
+// ctmp.h: the CTMP wire format and what the proxy and its benchmarks share
+#pragma once
+#include <arpa/inet.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CTMP_X86 1
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+constexpr int SOURCE_PORT = 33333;
+constexpr int DEST_PORT = 44444;
+constexpr int REPLAY_PORT = 55555; // destinations that start with a replay of recent frames
+constexpr int HEADER_LEN = 8;
+constexpr int MAX_BODY = 65535;
+constexpr uint8_t MAGIC = 0xCC;
+
+// Why a source's frame was rejected (and the source closed).
+enum class CtmpError : uint8_t
+{
+  None,
+  BadMagic,
+  BadLength, // body over MAX_BODY
+  BadPadding,
+  BadChecksum,
+  ShortRead, // the source closed part-way through a frame
+};
+
+constexpr unsigned CTMP_ERRORS = 6;
+inline const char *const ctmp_error_names[CTMP_ERRORS] = {"none", "bad_magic", "bad_length",
+                                                          "bad_padding", "bad_checksum", "short_read"};
+
+enum class ChecksumKernel
+{
+  Auto, // best one the CPU supports
+  Scalar,
+  Sse2,
+  Avx2,
+  Avx512,
+};
+
+// 16-bit one's-complement checksum of a byte buffer. This is the reference
+// the vector kernels below must match bit for bit.
+inline uint16_t checksum_scalar(const uint8_t *b, size_t n)
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i + 1 < n; i += 2)
+  {
+    sum += (uint16_t(b[i]) << 8) | b[i + 1];
+    if (sum > 0xFFFF)
+      sum = (sum & 0xFFFF) + 1; // fold
+  }
+  if (n & 1)
+  {
+    sum += uint16_t(b[n - 1]) << 8;
+    if (sum > 0xFFFF)
+      sum = (sum & 0xFFFF) + 1;
+  }
+  return uint16_t(~sum) & 0xFFFF;
+}
+
+#ifdef CTMP_X86
+// The vector kernels add little-endian 16-bit words into wide accumulators
+// and fold once at the end. One's-complement sums are byte-order independent
+// (RFC 1071), so swapping the folded result gives the big-endian sum, and
+// since a nonzero sum never folds to 0 this matches the per-word fold above.
+inline uint16_t checksum_finish(uint64_t sum, const uint8_t *p, size_t n)
+{
+  for (; n >= 2; p += 2, n -= 2)
+    sum += uint16_t(p[0] | (p[1] << 8));
+  if (n)
+    sum += p[0]; // odd tail is the high byte of a zero-padded word
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  const uint16_t be = uint16_t((sum >> 8) | (sum << 8));
+  return uint16_t(~be);
+}
+
+// Each step adds at most 2 * 0xFFFF to a 32-bit lane, so lanes are spilled
+// into the 64-bit total every CHECKSUM_SPILL vectors.
+constexpr size_t CHECKSUM_SPILL = 16384;
+
+inline uint16_t checksum_sse2(const uint8_t *p, size_t n)
+{
+  const __m128i lo16 = _mm_set1_epi32(0xFFFF);
+  uint64_t sum = 0;
+  while (n >= 16)
+  {
+    __m128i acc = _mm_setzero_si128();
+    for (size_t k = 0; k < CHECKSUM_SPILL && n >= 16; ++k, p += 16, n -= 16)
+    {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      acc = _mm_add_epi32(acc, _mm_and_si128(v, lo16));
+      acc = _mm_add_epi32(acc, _mm_srli_epi32(v, 16));
+    }
+    alignas(16) uint32_t lane[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lane), acc);
+    sum += uint64_t(lane[0]) + lane[1] + lane[2] + lane[3];
+  }
+  return checksum_finish(sum, p, n);
+}
+
+__attribute__((target("avx2"))) inline uint16_t checksum_avx2(const uint8_t *p, size_t n)
+{
+  const __m256i lo16 = _mm256_set1_epi32(0xFFFF);
+  uint64_t sum = 0;
+  while (n >= 32)
+  {
+    __m256i acc = _mm256_setzero_si256();
+    for (size_t k = 0; k < CHECKSUM_SPILL && n >= 32; ++k, p += 32, n -= 32)
+    {
+      const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+      acc = _mm256_add_epi32(acc, _mm256_and_si256(v, lo16));
+      acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+    }
+    alignas(32) uint32_t lane[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lane), acc);
+    for (uint32_t l : lane)
+      sum += l;
+  }
+  return checksum_finish(sum, p, n);
+}
+
+__attribute__((target("avx512f"))) inline uint16_t checksum_avx512(const uint8_t *p, size_t n)
+{
+  const __m512i lo16 = _mm512_set1_epi32(0xFFFF);
+  uint64_t sum = 0;
+  while (n >= 64)
+  {
+    __m512i acc = _mm512_setzero_si512();
+    for (size_t k = 0; k < CHECKSUM_SPILL && n >= 64; ++k, p += 64, n -= 64)
+    {
+      const __m512i v = _mm512_loadu_si512(p);
+      acc = _mm512_add_epi32(acc, _mm512_and_si512(v, lo16));
+      acc = _mm512_add_epi32(acc, _mm512_maskz_srli_epi32(0xFFFF, v, 16)); // maskz form: GCC 12 warns on the plain one
+    }
+    alignas(64) uint32_t lane[16];
+    _mm512_store_si512(lane, acc);
+    for (uint32_t l : lane)
+      sum += l;
+  }
+  return checksum_finish(sum, p, n);
+}
+#endif
+
+using ChecksumFn = uint16_t (*)(const uint8_t *, size_t);
+inline ChecksumFn compute_checksum = checksum_scalar; // picked once at startup
+
+// Checksum of a frame held as separate header and body spans, with the
+// checksum field (bytes 4-5) read as 0xCC 0xCC. Equal to compute_checksum
+// over a copy with those bytes overwritten: the header is a whole number of
+// words, so its words can simply be added to the body's sum.
+inline uint16_t frame_checksum(const uint8_t *hdr, const uint8_t *body, size_t len)
+{
+  uint32_t sum = uint16_t(~compute_checksum(body, len)); // body's folded sum
+  sum += (uint32_t(hdr[0]) << 8) | hdr[1];
+  sum += (uint32_t(hdr[2]) << 8) | hdr[3];
+  sum += 0xCCCC; // checksum field, per spec
+  sum += (uint32_t(hdr[6]) << 8) | hdr[7];
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return uint16_t(~sum);
+}
+
+// If sensitive (bit 1 -> 0x40), does the checksum field match the frame?
+inline bool checksum_ok(const uint8_t *hdr, const uint8_t *body, size_t len)
+{
+  if (!(hdr[1] & 0x40))
+    return true;
+  return ntohs(*reinterpret_cast<const uint16_t *>(hdr + 4)) == frame_checksum(hdr, body, len);
+}
+
+// Widest checksum kernel this CPU (and OS, for the AVX state) can run.
+inline ChecksumKernel best_checksum()
+{
+#ifdef CTMP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return ChecksumKernel::Avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return ChecksumKernel::Avx2;
+  return ChecksumKernel::Sse2;
+#else
+  return ChecksumKernel::Scalar;
+#endif
+}
+
+// The function behind kernel k (Auto and kernels this build lacks: scalar).
+inline ChecksumFn checksum_kernel(ChecksumKernel k)
+{
+  switch (k)
+  {
+#ifdef CTMP_X86
+  case ChecksumKernel::Sse2:
+    return checksum_sse2;
+  case ChecksumKernel::Avx2:
+    return checksum_avx2;
+  case ChecksumKernel::Avx512:
+    return checksum_avx512;
+#endif
+  default:
+    return checksum_scalar;
+  }
+}
+
+// Validate magic, length and padding; on success len holds the body length.
+inline CtmpError check_header(const uint8_t *hdr, uint16_t &len)
+{
+  if (hdr[0] != MAGIC)
+    return CtmpError::BadMagic;
+
+  len = ntohs(*reinterpret_cast<const uint16_t *>(hdr + 2));
+  if (len > MAX_BODY)
+    return CtmpError::BadLength;
+  if (hdr[6] != 0 || hdr[7] != 0)
+    return CtmpError::BadPadding; // padding must be zero
+  return CtmpError::None;
+}
+
+// A frame found in a buffer: where its header starts, its whole length
+// (header + body) and its OPTIONS byte.
+struct FrameView
+{
+  size_t offset;
+  uint32_t len;
+  uint8_t options;
+};
+
+// Decode the frame at the start of p[0..n) into v (offset 0). ShortRead
+// means p ends part-way through it: more bytes may complete it. Any other
+// error means the stream is invalid here. With verify, the checksum of a
+// sensitive frame is checked too.
+inline CtmpError ctmp_decode(const uint8_t *p, size_t n, FrameView &v, bool verify = true)
+{
+  if (n < size_t(HEADER_LEN))
+    return n > 0 && p[0] != MAGIC ? CtmpError::BadMagic : CtmpError::ShortRead;
+  uint16_t len;
+  const CtmpError e = check_header(p, len);
+  if (e != CtmpError::None)
+    return e;
+  if (n - HEADER_LEN < len)
+    return CtmpError::ShortRead;
+  if (verify && !checksum_ok(p, p + HEADER_LEN, len))
+    return CtmpError::BadChecksum;
+  v = FrameView{0, uint32_t(HEADER_LEN + len), p[1]};
+  return CtmpError::None;
+}
+
+// What ctmp_decode_batch found: frames views filled, spanning the first used
+// bytes. error says why it stopped: None when the views ran out or p ended
+// on a frame boundary, otherwise what ctmp_decode said of the frame at used.
+struct DecodeResult
+{
+  size_t frames;
+  size_t used;
+  CtmpError error;
+};
+
+// Decode up to max consecutive frames from p[0..n) into out. Each frame's
+// length locates the next header, which is prefetched while this frame's
+// checksum (with verify) is worked out.
+inline DecodeResult ctmp_decode_batch(const uint8_t *p, size_t n, FrameView *out, size_t max, bool verify = true)
+{
+  DecodeResult r{0, 0, CtmpError::None};
+  while (r.frames < max && r.used < n)
+  {
+    FrameView &v = out[r.frames];
+    r.error = ctmp_decode(p + r.used, n - r.used, v, false);
+    if (r.error != CtmpError::None)
+      return r;
+    if (v.len < n - r.used)
+      __builtin_prefetch(p + r.used + v.len);
+    if (verify && !checksum_ok(p + r.used, p + r.used + HEADER_LEN, v.len - HEADER_LEN))
+    {
+      r.error = CtmpError::BadChecksum;
+      return r;
+    }
+    v.offset = r.used;
+    r.used += v.len;
+    ++r.frames;
+  }
+  return r;
+}
+
+inline uint64_t now_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+}
+
+// Log-linear histogram of nanosecond values, HDR style: exact below 16,
+// then 16 linear steps per power of two (about 6% resolution) up to 2^40 ns.
+// One thread records; others may read it at any time, hence relaxed
+// atomics rather than a lock.
+class Histogram
+{
+public:
+  static constexpr unsigned SUB_BITS = 4;
+  static constexpr unsigned MAX_BITS = 40;
+  static constexpr unsigned BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+  void record(uint64_t ns, uint64_t n = 1)
+  {
+    std::atomic<uint64_t> &c = counts_[bucket(ns)];
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  void merge(const Histogram &o)
+  {
+    for (unsigned i = 0; i < BUCKETS; ++i)
+      if (uint64_t n = o.counts_[i].load(std::memory_order_relaxed))
+        counts_[i].store(counts_[i].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  void clear()
+  {
+    for (auto &c : counts_)
+      c.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const
+  {
+    uint64_t n = 0;
+    for (const auto &c : counts_)
+      n += c.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  // Upper bound of the bucket holding quantile q (0..1) of what was recorded.
+  uint64_t quantile(double q) const
+  {
+    const uint64_t total = count();
+    if (total == 0)
+      return 0;
+    const uint64_t want = std::max<uint64_t>(1, uint64_t(q * double(total) + 0.5));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < BUCKETS; ++i)
+      if ((seen += counts_[i].load(std::memory_order_relaxed)) >= want)
+        return upper(i);
+    return upper(BUCKETS - 1);
+  }
+
+private:
+  static unsigned bucket(uint64_t v)
+  {
+    v = std::min(v, (uint64_t(1) << MAX_BITS) - 1);
+    if (v < (1u << SUB_BITS))
+      return unsigned(v);
+    const unsigned shift = 63 - unsigned(__builtin_clzll(v)) - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) + unsigned((v >> shift) & ((1u << SUB_BITS) - 1));
+  }
+
+  static uint64_t upper(unsigned i)
+  {
+    if (i < (1u << SUB_BITS))
+      return i;
+    const unsigned shift = (i >> SUB_BITS) - 1;
+    const uint64_t sub = i & ((1u << SUB_BITS) - 1);
+    return (((1u << SUB_BITS) + sub + 1) << shift) - 1;
+  }
+
+  std::atomic<uint64_t> counts_[BUCKETS] = {};
+};
+
+// One row of a latency table: name, count, then p50, p90, p99, p99.9 and
+// max in ns, under the header the proxy and ctmp_bench print.
+inline std::string latency_line(const std::string &name, const Histogram &h)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line), "    %-24s %10llu %9llu %9llu %9llu %9llu %9llu\n", name.c_str(),
+                static_cast<unsigned long long>(h.count()),
+                static_cast<unsigned long long>(h.quantile(0.5)),
+                static_cast<unsigned long long>(h.quantile(0.9)),
+                static_cast<unsigned long long>(h.quantile(0.99)),
+                static_cast<unsigned long long>(h.quantile(0.999)),
+                static_cast<unsigned long long>(h.quantile(1)));
+  return line;
+}
@@ -0,0 +1,511 @@
+// ctmp_bench.cpp: load generator and fan-out checker for a running ctmp_proxy
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ctmp.h"
+
+constexpr size_t STAMP_LEN = 20;          // body prefix: source, sequence number, send time
+constexpr size_t SEND_CHUNK = 256 << 10;  // frames built and sent per write
+constexpr size_t RECV_CHUNK = 256 << 10;  // bytes one recv may take
+constexpr int SETTLE_MS = 200;            // destinations get this long to be accepted
+constexpr uint64_t IDLE_NS = 2000000000u; // once the sources are done, receivers give up after this much silence
+
+// Bodies drawn uniformly from [min, max], this class picked with weight.
+struct SizeClass
+{
+  uint32_t min, max;
+  uint32_t weight;
+};
+
+struct Options
+{
+  const char *host = "127.0.0.1";
+  unsigned channel = 0;
+  unsigned sources = 1;
+  unsigned sinks = 4;
+  unsigned threads = 0;     // receiver threads (0 = up to half the cores)
+  uint64_t frames = 100000; // per source
+  double rate = 0;          // frames per second per source (0 = as fast as possible)
+  std::vector<SizeClass> sizes{{STAMP_LEN, 256, 1}};
+  double sensitive = 0.1; // share of frames with the checksum flag
+  uint64_t seed = 1;
+};
+
+Options options;
+std::atomic<unsigned> sources_done{0};
+std::atomic<uint64_t> last_sent_ns{0}; // when the last source finished
+
+// xorshift64*: cheap and the same on every run for a given seed.
+struct Rng
+{
+  uint64_t s;
+
+  explicit Rng(uint64_t seed) : s(seed ? seed : 1) {}
+
+  uint64_t next()
+  {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return s * 0x2545F4914F6CDD1Dull;
+  }
+
+  double unit() { return double(next() >> 11) / double(1ull << 53); }
+};
+
+// Byte i of the body after the stamp, so every byte of every frame is checked.
+static uint8_t pattern(uint64_t seq, size_t i)
+{
+  return uint8_t(seq * 131 + i * 7);
+}
+
+static void put64(uint8_t *p, uint64_t v)
+{
+  for (int i = 0; i < 8; ++i)
+    p[i] = uint8_t(v >> (8 * i));
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < 8; ++i)
+    v |= uint64_t(p[i]) << (8 * i);
+  return v;
+}
+
+static uint32_t pick_size(Rng &rng)
+{
+  uint64_t total = 0;
+  for (const SizeClass &c : options.sizes)
+    total += c.weight;
+  uint64_t w = rng.next() % total;
+  const SizeClass *c = &options.sizes[0];
+  for (const SizeClass &x : options.sizes)
+  {
+    if (w < x.weight)
+    {
+      c = &x;
+      break;
+    }
+    w -= x.weight;
+  }
+  return c->min + uint32_t(rng.next() % (uint64_t(c->max - c->min) + 1));
+}
+
+// Append frame seq of source id, stamped with now, to out.
+static void append_frame(std::vector<uint8_t> &out, unsigned id, uint64_t seq, uint64_t now, Rng &rng)
+{
+  const uint32_t len = pick_size(rng);
+  const bool sensitive = rng.unit() < options.sensitive;
+  const size_t at = out.size();
+  out.resize(at + HEADER_LEN + len);
+  uint8_t *h = out.data() + at;
+  uint8_t *b = h + HEADER_LEN;
+  h[0] = MAGIC;
+  h[1] = sensitive ? 0x40 : 0;
+  *reinterpret_cast<uint16_t *>(h + 2) = htons(uint16_t(len));
+  h[4] = h[5] = h[6] = h[7] = 0;
+  b[0] = uint8_t(id);
+  b[1] = uint8_t(id >> 8);
+  b[2] = uint8_t(id >> 16);
+  b[3] = uint8_t(id >> 24);
+  put64(b + 4, seq);
+  put64(b + 12, now);
+  for (size_t i = STAMP_LEN; i < len; ++i)
+    b[i] = pattern(seq, i);
+  if (sensitive)
+    *reinterpret_cast<uint16_t *>(h + 4) = htons(frame_checksum(h, b, len));
+}
+
+static int connect_to(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    perror("socket");
+    std::exit(1);
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, options.host, &addr.sin_addr) != 1)
+  {
+    std::cerr << "[!] bad host " << options.host << '\n';
+    std::exit(2);
+  }
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+  {
+    perror("connect");
+    std::exit(1);
+  }
+  return fd;
+}
+
+struct SourceResult
+{
+  uint64_t frames = 0, bytes = 0;
+};
+
+// One source connection: send options.frames frames, paced to options.rate.
+static void run_source(unsigned id, SourceResult &res)
+{
+  const int fd = connect_to(SOURCE_PORT + int(options.channel));
+  Rng rng(options.seed * 0x9E3779B97F4A7C15ull + id);
+  std::vector<uint8_t> buf;
+  buf.reserve(SEND_CHUNK + HEADER_LEN + MAX_BODY);
+  const uint64_t start = now_ns();
+  for (uint64_t seq = 0; seq < options.frames;)
+  {
+    uint64_t now = now_ns();
+    uint64_t limit = options.frames;
+    if (options.rate > 0)
+    {
+      limit = std::min(limit, uint64_t(double(now - start) * options.rate / 1e9) + 1);
+      if (seq >= limit)
+      {
+        const uint64_t due = start + uint64_t(double(seq) * 1e9 / options.rate);
+        timespec ts{0, long(std::min<uint64_t>(due - std::min(due, now), 1000000))};
+        nanosleep(&ts, nullptr);
+        continue;
+      }
+    }
+    buf.clear();
+    while (seq < limit && buf.size() < SEND_CHUNK)
+      append_frame(buf, id, seq++, now, rng);
+    for (size_t off = 0; off < buf.size();)
+    {
+      const ssize_t n = send(fd, buf.data() + off, buf.size() - off, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+      {
+        perror("[!] source send");
+        std::exit(1);
+      }
+      off += size_t(n);
+    }
+    res.frames = seq;
+    res.bytes += buf.size();
+  }
+  close(fd);
+  last_sent_ns.store(now_ns());
+  sources_done.fetch_add(1);
+}
+
+// One destination connection and what it has received.
+struct Sink
+{
+  int fd = -1;
+  std::vector<uint8_t> buf;
+  size_t have = 0;
+  std::vector<uint64_t> next; // per source: sequence number expected next
+  uint64_t frames = 0, bytes = 0;
+  uint64_t drops = 0, errors = 0;
+  uint64_t last_ns = 0; // last receive
+  bool open = true;
+  Histogram latency;
+};
+
+static void sink_error(Sink &k, const char *what)
+{
+  if (k.errors++ == 0)
+    std::cerr << "[!] sink fd " << k.fd << ": " << what << '\n';
+}
+
+// Check one complete frame: checksum, stamp, order and every body byte.
+static void check_frame(Sink &k, const uint8_t *h, uint16_t len, uint64_t now)
+{
+  const uint8_t *b = h + HEADER_LEN;
+  if (!checksum_ok(h, b, len))
+    return sink_error(k, "checksum mismatch");
+  if (len < STAMP_LEN)
+    return sink_error(k, "frame too short for a stamp");
+  const uint32_t src = b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+  const uint64_t seq = get64(b + 4);
+  if (src >= k.next.size())
+    return sink_error(k, "unknown source");
+  if (seq < k.next[src])
+    return sink_error(k, "duplicate or reordered frame");
+  for (size_t i = STAMP_LEN; i < len; ++i)
+    if (b[i] != pattern(seq, i))
+      return sink_error(k, "corrupt body");
+  k.drops += seq - k.next[src];
+  k.next[src] = seq + 1;
+  ++k.frames;
+  k.bytes += HEADER_LEN + len;
+  k.latency.record(now - std::min(now, get64(b + 12)));
+}
+
+// Parse every complete frame in k.buf, keeping a partial one for later.
+static void consume(Sink &k, uint64_t now)
+{
+  FrameView views[64];
+  size_t off = 0;
+  for (;;)
+  {
+    const uint8_t *p = k.buf.data() + off;
+    const DecodeResult d = ctmp_decode_batch(p, k.have - off, views, 64, false); // check_frame verifies
+    for (size_t i = 0; i < d.frames; ++i)
+      check_frame(k, p + views[i].offset, uint16_t(views[i].len - HEADER_LEN), now);
+    off += d.used;
+    if (d.error != CtmpError::None && d.error != CtmpError::ShortRead)
+    {
+      sink_error(k, ctmp_error_names[unsigned(d.error)]);
+      k.open = false;
+      return;
+    }
+    if (d.error != CtmpError::None || off == k.have)
+      break;
+  }
+  std::memmove(k.buf.data(), k.buf.data() + off, k.have - off);
+  k.have -= off;
+}
+
+static bool sink_complete(const Sink &k)
+{
+  if (!k.open)
+    return true;
+  for (uint64_t n : k.next)
+    if (n < options.frames)
+      return false;
+  return true;
+}
+
+// Receive on a share of the destinations until each has every frame, or
+// the sources are done and nothing has arrived for IDLE_NS.
+static void run_receiver(std::vector<Sink *> sinks)
+{
+  const int epfd = epoll_create1(EPOLL_CLOEXEC);
+  for (Sink *k : sinks)
+  {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = k;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, k->fd, &ev);
+  }
+  epoll_event events[64];
+  uint64_t last = now_ns();
+  for (;;)
+  {
+    if (std::all_of(sinks.begin(), sinks.end(), [](const Sink *k) { return sink_complete(*k); }))
+      break;
+    const int n = epoll_wait(epfd, events, 64, 100);
+    const uint64_t now = now_ns();
+    if (n <= 0)
+    {
+      if (sources_done.load() == options.sources && now - std::max(last, last_sent_ns.load()) > IDLE_NS)
+        break;
+      continue;
+    }
+    last = now;
+    for (int i = 0; i < n; ++i)
+    {
+      Sink &k = *static_cast<Sink *>(events[i].data.ptr);
+      const ssize_t got = recv(k.fd, k.buf.data() + k.have, k.buf.size() - k.have, MSG_DONTWAIT);
+      if (got < 0 && (errno == EAGAIN || errno == EINTR))
+        continue;
+      if (got > 0)
+      {
+        k.have += size_t(got);
+        k.last_ns = now;
+        consume(k, now);
+      }
+      if (got <= 0 || !k.open)
+      {
+        k.open = false;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, k.fd, nullptr);
+      }
+    }
+  }
+  close(epfd);
+}
+
+static void usage(const char *argv0)
+{
+  std::cerr << "usage: " << argv0
+            << " [--host IP] [--channel C] [--sources N] [--sinks N] [--threads N]\n"
+            << "       [--frames N] [--rate N] [--sizes SPEC] [--sensitive RATIO] [--seed N]\n"
+            << "  --host IP          proxy address (default: 127.0.0.1)\n"
+            << "  --channel C        use ports 33333+C and 44444+C (default: 0)\n"
+            << "  --sources N        source connections, each sending its own sequence (default: 1)\n"
+            << "  --sinks N          destination connections (default: 4)\n"
+            << "  --threads N        receiver threads (default: up to half the cores)\n"
+            << "  --frames N         frames per source (default: 100000)\n"
+            << "  --rate N           frames per second per source (default: 0, as fast as possible)\n"
+            << "  --sizes SPEC       body sizes: N, MIN-MAX, or a weighted list like 64:90,1500:9,65535:1\n"
+            << "                     (each item a size or range; at least 20 bytes; default: 20-256)\n"
+            << "  --sensitive RATIO  share of frames with a checksum, 0 to 1 (default: 0.1)\n"
+            << "  --seed N           frame sizes and flags are reproducible per seed (default: 1)\n"
+            << "Exits 1 if any destination missed or failed to verify a frame.\n";
+  std::exit(2);
+}
+
+static bool parse_sizes(const char *spec, std::vector<SizeClass> &out)
+{
+  out.clear();
+  for (const char *p = spec; *p;)
+  {
+    char *end;
+    SizeClass c{0, 0, 1};
+    c.min = c.max = uint32_t(std::strtoul(p, &end, 10));
+    if (end == p)
+      return false;
+    if (*end == '-')
+    {
+      p = end + 1;
+      c.max = uint32_t(std::strtoul(p, &end, 10));
+      if (end == p)
+        return false;
+    }
+    if (*end == ':')
+    {
+      p = end + 1;
+      c.weight = uint32_t(std::strtoul(p, &end, 10));
+      if (end == p || c.weight == 0)
+        return false;
+    }
+    if (c.min < STAMP_LEN || c.min > c.max || c.max > uint32_t(MAX_BODY))
+      return false;
+    out.push_back(c);
+    if (*end == ',')
+      ++end;
+    else if (*end)
+      return false;
+    p = end;
+  }
+  return !out.empty();
+}
+
+static Options parse_args(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *a = argv[i];
+    if (std::strcmp(a, "--host") == 0 && i + 1 < argc)
+      opt.host = argv[++i];
+    else if (std::strcmp(a, "--channel") == 0 && i + 1 < argc)
+      opt.channel = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--sources") == 0 && i + 1 < argc)
+      opt.sources = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--sinks") == 0 && i + 1 < argc)
+      opt.sinks = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--threads") == 0 && i + 1 < argc)
+      opt.threads = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--frames") == 0 && i + 1 < argc)
+      opt.frames = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--rate") == 0 && i + 1 < argc)
+      opt.rate = std::atof(argv[++i]);
+    else if (std::strcmp(a, "--sizes") == 0 && i + 1 < argc)
+    {
+      if (!parse_sizes(argv[++i], opt.sizes))
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--sensitive") == 0 && i + 1 < argc)
+      opt.sensitive = std::atof(argv[++i]);
+    else if (std::strcmp(a, "--seed") == 0 && i + 1 < argc)
+      opt.seed = std::strtoull(argv[++i], nullptr, 10);
+    else
+      usage(argv[0]);
+  }
+  if (opt.sources == 0 || opt.sinks == 0 || opt.rate < 0 || opt.sensitive < 0 || opt.sensitive > 1)
+    usage(argv[0]);
+  if (opt.threads == 0)
+    opt.threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  opt.threads = std::min(opt.threads, opt.sinks);
+  return opt;
+}
+
+int main(int argc, char **argv)
+{
+  options = parse_args(argc, argv);
+  const Options &opt = options;
+  compute_checksum = checksum_kernel(best_checksum());
+
+  std::vector<std::unique_ptr<Sink>> sinks;
+  for (unsigned i = 0; i < opt.sinks; ++i)
+  {
+    auto k = std::make_unique<Sink>();
+    k->fd = connect_to(DEST_PORT + int(opt.channel));
+    k->buf.resize(RECV_CHUNK + HEADER_LEN + MAX_BODY);
+    k->next.assign(opt.sources, 0);
+    sinks.push_back(std::move(k));
+  }
+  timespec settle{0, SETTLE_MS * 1000000L};
+  nanosleep(&settle, nullptr);
+
+  std::vector<std::thread> receivers;
+  for (unsigned t = 0; t < opt.threads; ++t)
+  {
+    std::vector<Sink *> share;
+    for (size_t i = t; i < sinks.size(); i += opt.threads)
+      share.push_back(sinks[i].get());
+    receivers.emplace_back(run_receiver, std::move(share));
+  }
+  const uint64_t start = now_ns();
+  std::vector<SourceResult> sent(opt.sources);
+  std::vector<std::thread> senders;
+  for (unsigned i = 0; i < opt.sources; ++i)
+    senders.emplace_back(run_source, i, std::ref(sent[i]));
+  for (auto &t : senders)
+    t.join();
+  const uint64_t sent_ns = now_ns() - start;
+  for (auto &t : receivers)
+    t.join();
+
+  uint64_t tx_frames = 0, tx_bytes = 0;
+  for (const SourceResult &s : sent)
+  {
+    tx_frames += s.frames;
+    tx_bytes += s.bytes;
+  }
+  uint64_t rx_frames = 0, rx_bytes = 0, drops = 0, errors = 0, last = start;
+  unsigned closed = 0;
+  Histogram all;
+  std::string lines;
+  for (size_t i = 0; i < sinks.size(); ++i)
+  {
+    Sink *k = sinks[i].get();
+    for (unsigned s = 0; s < opt.sources; ++s)
+      k->drops += sent[s].frames - std::min(sent[s].frames, k->next[s]); // never arrived
+    rx_frames += k->frames;
+    rx_bytes += k->bytes;
+    drops += k->drops;
+    errors += k->errors;
+    closed += k->open ? 0 : 1;
+    last = std::max(last, k->last_ns);
+    all.merge(k->latency);
+    lines += latency_line("sink " + std::to_string(i) + " drops " + std::to_string(k->drops), k->latency);
+    close(k->fd);
+  }
+
+  const double tx_s = double(sent_ns) / 1e9;
+  const double rx_s = double(last - start) / 1e9;
+  std::printf("[*] sent %llu frames, %llu bytes in %.3f s from %u sources: %.0f frames/s, %.1f MB/s\n",
+              static_cast<unsigned long long>(tx_frames), static_cast<unsigned long long>(tx_bytes), tx_s,
+              opt.sources, double(tx_frames) / tx_s, double(tx_bytes) / tx_s / 1e6);
+  std::printf("[*] received %llu frames, %llu bytes in %.3f s on %u sinks: %.0f frames/s, %.1f MB/s\n",
+              static_cast<unsigned long long>(rx_frames), static_cast<unsigned long long>(rx_bytes), rx_s,
+              opt.sinks, rx_s > 0 ? double(rx_frames) / rx_s : 0.0, rx_s > 0 ? double(rx_bytes) / rx_s / 1e6 : 0.0);
+  std::printf("[*] drops %llu, errors %llu, sinks closed early %u\n", static_cast<unsigned long long>(drops),
+              static_cast<unsigned long long>(errors), closed);
+  std::printf("[*] latency, ns:                       count       p50       p90       p99     p99.9       max\n");
+  std::printf("%s%s", latency_line("all sinks", all).c_str(), lines.c_str());
+  return drops > 0 || errors > 0 ? 1 : 0;
+}
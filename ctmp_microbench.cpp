@@ -0,0 +1,315 @@
+// ctmp_microbench.cpp: checksum kernels and frame validation over in-memory buffers
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ctmp.h"
+
+constexpr unsigned RUNS = 5;                 // timed runs per case; the fastest counts
+constexpr size_t STREAM_BYTES = 1 << 20;     // validation streams hold at least this much
+constexpr size_t STREAM_MIN_FRAMES = 64;     // and at least this many frames
+constexpr size_t VERIFY_ALL_UP_TO = 4096;    // every length up to here is checked against scalar
+constexpr size_t VERIFY_STEP = 251;          // then every 251st, and the last two
+constexpr size_t MAX_OFFSET = 64;            // start offsets 0..63 cover every alignment
+constexpr size_t DECODE_VIEWS = 256;         // frames per ctmp_decode_batch call
+
+struct Kernel
+{
+  const char *name;
+  ChecksumKernel kind;
+};
+
+const Kernel kernels[] = {
+    {"scalar", ChecksumKernel::Scalar},
+    {"sse2", ChecksumKernel::Sse2},
+    {"avx2", ChecksumKernel::Avx2},
+    {"avx512", ChecksumKernel::Avx512},
+};
+
+struct Options
+{
+  unsigned time_ms = 50; // per case
+  std::vector<size_t> sizes{0, 1, 7, 16, 63, 64, 255, 256, 1500, 4096, 16384, 65535};
+  std::vector<size_t> frame_sizes{0, 16, 64, 256, 1500, 4096, 65535};
+  std::vector<unsigned> aligns{0, 1};
+};
+
+Options options;
+
+// Keep the compiler from hoisting or dropping a call whose inputs look constant.
+template <typename T>
+static void opaque(T &v)
+{
+  asm volatile("" : "+r"(v) : : "memory");
+}
+
+// ns per iteration of body(iters): iters grows until a run takes its share
+// of options.time_ms, then the fastest of RUNS runs counts.
+template <typename F>
+static double measure(F &&body)
+{
+  const uint64_t share = uint64_t(options.time_ms) * 1000000u / RUNS;
+  uint64_t iters = 1;
+  for (;;)
+  {
+    const uint64_t t0 = now_ns();
+    body(iters);
+    if (now_ns() - t0 >= share || iters >= (uint64_t(1) << 40))
+      break;
+    iters *= 2;
+  }
+  uint64_t best = UINT64_MAX;
+  for (unsigned r = 0; r < RUNS; ++r)
+  {
+    const uint64_t t0 = now_ns();
+    body(iters);
+    best = std::min(best, now_ns() - t0);
+  }
+  return double(best) / double(iters);
+}
+
+static void fill(uint8_t *p, size_t n, unsigned pattern, uint64_t seed)
+{
+  for (size_t i = 0; i < n; ++i)
+  {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    p[i] = pattern == 0 ? uint8_t(seed >> 56) : pattern == 1 ? 0xFF : 0x00;
+  }
+}
+
+// Every kernel this CPU runs must give the scalar result, for plain
+// checksums and for frame_checksum against the copy-and-patch definition.
+static bool verify(const std::vector<const Kernel *> &usable)
+{
+  std::vector<uint8_t> buf(MAX_OFFSET + HEADER_LEN + MAX_BODY);
+  std::vector<uint8_t> copy(HEADER_LEN + MAX_BODY);
+  std::vector<size_t> lengths;
+  for (size_t n = 0; n <= size_t(MAX_BODY); n += n < VERIFY_ALL_UP_TO ? 1 : VERIFY_STEP)
+    lengths.push_back(n);
+  lengths.push_back(size_t(MAX_BODY) - 1);
+  lengths.push_back(size_t(MAX_BODY));
+
+  uint64_t cases = 0;
+  for (unsigned pattern = 0; pattern < 3; ++pattern)
+  {
+    fill(buf.data(), buf.size(), pattern, pattern + 1);
+    for (size_t n : lengths)
+    {
+      for (size_t off = 0; off < MAX_OFFSET; off += n < VERIFY_ALL_UP_TO ? 1 : 7)
+      {
+        const uint8_t *p = buf.data() + off;
+        const uint16_t want = checksum_scalar(p, n);
+        // The frame view: a header at p (body length n - HEADER_LEN), checksum field as 0xCC.
+        uint16_t want_frame = 0;
+        if (n >= size_t(HEADER_LEN))
+        {
+          std::memcpy(copy.data(), p, n);
+          copy[4] = copy[5] = 0xCC;
+          want_frame = checksum_scalar(copy.data(), n);
+        }
+        for (const Kernel *k : usable)
+        {
+          compute_checksum = checksum_kernel(k->kind);
+          const bool ok = compute_checksum(p, n) == want &&
+                          (n < size_t(HEADER_LEN) || frame_checksum(p, p + HEADER_LEN, n - HEADER_LEN) == want_frame);
+          if (!ok)
+          {
+            std::cerr << "[!] " << k->name << " differs from scalar: " << n << " bytes at offset " << off
+                      << ", pattern " << pattern << '\n';
+            return false;
+          }
+          ++cases;
+        }
+      }
+    }
+  }
+  std::printf("[*] verify: %llu cases, every kernel matches scalar\n", static_cast<unsigned long long>(cases));
+  return true;
+}
+
+static void bench_checksum(const std::vector<const Kernel *> &usable)
+{
+  std::vector<uint8_t> buf(MAX_OFFSET + MAX_BODY);
+  fill(buf.data(), buf.size(), 0, 42);
+  std::printf("[*] checksum, ns/call  GB/s  (speedup over scalar):\n    %6s %5s", "bytes", "align");
+  for (const Kernel *k : usable)
+    std::printf(" %27s", k->name);
+  std::printf("\n");
+  for (size_t n : options.sizes)
+  {
+    for (unsigned align : options.aligns)
+    {
+      std::printf("    %6zu %5u", n, align);
+      double scalar_ns = 0;
+      for (const Kernel *k : usable)
+      {
+        const ChecksumFn fn = checksum_kernel(k->kind);
+        const uint8_t *p = buf.data() + align;
+        const double ns = measure([&](uint64_t iters)
+                                  {
+                                    uint64_t sum = 0;
+                                    for (uint64_t i = 0; i < iters; ++i)
+                                    {
+                                      opaque(p);
+                                      sum += fn(p, n);
+                                    }
+                                    opaque(sum); });
+        if (k->kind == ChecksumKernel::Scalar)
+          scalar_ns = ns;
+        std::printf(" %9.1f %7.2f (%5.1fx)", ns, double(n) / ns, scalar_ns / ns);
+      }
+      std::printf("\n");
+    }
+  }
+}
+
+// Decode and verify a whole in-memory stream in batches, as the proxy's
+// socket path does. Returns how many frames passed.
+static size_t validate(const uint8_t *p, size_t n)
+{
+  FrameView views[DECODE_VIEWS];
+  size_t frames = 0;
+  for (size_t off = 0; off < n;)
+  {
+    const DecodeResult d = ctmp_decode_batch(p + off, n - off, views, DECODE_VIEWS);
+    frames += d.frames;
+    off += d.used;
+    if (d.error != CtmpError::None)
+      break;
+  }
+  return frames;
+}
+
+// A stream of frames with size-byte bodies, sensitive_pct of them sensitive
+// (spread evenly), starting align bytes into out.
+static size_t build_stream(std::vector<uint8_t> &out, size_t size, unsigned sensitive_pct, unsigned align)
+{
+  const size_t frames = std::max(STREAM_MIN_FRAMES, STREAM_BYTES / (HEADER_LEN + size));
+  out.assign(align + frames * (HEADER_LEN + size), 0);
+  uint8_t *h = out.data() + align;
+  for (size_t i = 0; i < frames; ++i, h += HEADER_LEN + size)
+  {
+    fill(h + HEADER_LEN, size, 0, i);
+    h[0] = MAGIC;
+    h[1] = (i + 1) * sensitive_pct / 100 != i * sensitive_pct / 100 ? 0x40 : 0;
+    *reinterpret_cast<uint16_t *>(h + 2) = htons(uint16_t(size));
+    if (h[1] & 0x40)
+      *reinterpret_cast<uint16_t *>(h + 4) = htons(frame_checksum(h, h + HEADER_LEN, size));
+  }
+  return frames;
+}
+
+static bool bench_validation(const Kernel &best)
+{
+  compute_checksum = checksum_kernel(best.kind);
+  std::printf("[*] validation (ctmp_decode_batch, %s), per frame:\n", best.name);
+  std::printf("    %6s %5s %9s %9s %7s\n", "bytes", "align", "sensitive", "ns", "GB/s");
+  std::vector<uint8_t> stream;
+  for (size_t n : options.frame_sizes)
+  {
+    for (unsigned pct : {0u, 50u, 100u})
+    {
+      for (unsigned align : options.aligns)
+      {
+        const size_t frames = build_stream(stream, n, pct, align);
+        const uint8_t *p = stream.data() + align;
+        const size_t bytes = stream.size() - align;
+        if (validate(p, bytes) != frames)
+        {
+          std::cerr << "[!] validation rejected a well-formed stream\n";
+          return false;
+        }
+        const double ns = measure([&](uint64_t iters)
+                                  {
+                                    size_t ok = 0;
+                                    for (uint64_t i = 0; i < iters; ++i)
+                                    {
+                                      opaque(p);
+                                      ok += validate(p, bytes);
+                                    }
+                                    opaque(ok); }) /
+                          double(frames);
+        std::printf("    %6zu %5u %8u%% %9.1f %7.2f\n", n, align, pct, ns, double(HEADER_LEN + n) / ns);
+      }
+    }
+  }
+  return true;
+}
+
+static void usage(const char *argv0)
+{
+  std::cerr << "usage: " << argv0 << " [--time-ms N] [--sizes N,N,...] [--frame-sizes N,N,...] [--verify-only]\n"
+            << "  --time-ms N         time spent per case (default: 50)\n"
+            << "  --sizes LIST        checksum lengths in bytes (default: 0,1,7,16,63,64,255,256,1500,4096,16384,65535)\n"
+            << "  --frame-sizes LIST  body sizes of the validation streams (default: 0,16,64,256,1500,4096,65535)\n"
+            << "  --verify-only       only check every kernel against scalar\n"
+            << "Exits 1 if a kernel's result differs from the scalar reference.\n";
+  std::exit(2);
+}
+
+static bool parse_list(const char *p, std::vector<size_t> &out)
+{
+  out.clear();
+  while (*p)
+  {
+    char *end;
+    const unsigned long v = std::strtoul(p, &end, 10);
+    if (end == p || v > unsigned(MAX_BODY))
+      return false;
+    out.push_back(v);
+    p = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',')
+      return false;
+  }
+  return !out.empty();
+}
+
+int main(int argc, char **argv)
+{
+  bool verify_only = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *a = argv[i];
+    if (std::strcmp(a, "--time-ms") == 0 && i + 1 < argc)
+      options.time_ms = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--sizes") == 0 && i + 1 < argc)
+    {
+      if (!parse_list(argv[++i], options.sizes))
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--frame-sizes") == 0 && i + 1 < argc)
+    {
+      if (!parse_list(argv[++i], options.frame_sizes))
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--verify-only") == 0)
+      verify_only = true;
+    else
+      usage(argv[0]);
+  }
+  if (options.time_ms == 0)
+    usage(argv[0]);
+
+  const ChecksumKernel best = best_checksum();
+  std::vector<const Kernel *> usable;
+  for (const Kernel &k : kernels)
+    if (k.kind <= best)
+      usable.push_back(&k);
+  std::printf("[*] checksum kernels on this CPU:");
+  for (const Kernel *k : usable)
+    std::printf(" %s", k->name);
+  std::printf("\n");
+
+  if (!verify(usable))
+    return 1;
+  if (verify_only)
+    return 0;
+  bench_checksum(usable);
+  return bench_validation(*usable.back()) ? 0 : 1;
+}
@@ -1,159 +1,2766 @@
 // main.cpp
 #include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/io_uring.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <new>
+#include <string>
 #include <thread>
 #include <vector>
 
-constexpr int SOURCE_PORT = 33333;
-constexpr int DEST_PORT = 44444;
-constexpr int HEADER_LEN = 8;
-constexpr int MAX_BODY = 65535;
-constexpr uint8_t MAGIC = 0xCC;
+#include "ctmp.h"
+
+constexpr unsigned MAX_CHANNELS = 1024;
+
+constexpr int MAX_EVENTS = 256;
+constexpr int READS_PER_WAKE = 4;            // per source, keeps sources fair
+constexpr size_t RX_BUF_SIZE = 256 << 10;    // per reactor; one recv takes up to this much
+constexpr size_t DECODE_BATCH = 64;          // whole frames decoded per ctmp_decode_batch call
+constexpr size_t SINK_IOV_MAX = 1024;        // frames gathered into one sink write (IOV_MAX)
+constexpr size_t SINK_SEND_BYTES = 1 << 20;  // bytes gathered into one sink write
+
+constexpr unsigned URING_SQ_ENTRIES = 1024;
+constexpr unsigned URING_CQ_ENTRIES = 4096;
+constexpr unsigned RECV_BUFS = 64; // provided buffers for multishot recv
+constexpr unsigned RECV_BUF_SIZE = 64 << 10;
+
+constexpr size_t BROADCAST_SLOTS = 1 << 14; // frames a reactor can have in flight to its peers
+constexpr size_t JOURNAL_SLOTS = 1 << 14;   // frames a reactor can have waiting for the journal
+constexpr size_t UNORDERED_MAX = 1 << 14;   // frames waiting for the sequencer before the others pause
+constexpr unsigned PARSE_SAMPLE = 64;       // one frame in this many has its parse and checksum timed
+
+constexpr unsigned POOL_MIN_SHIFT = 6;        // smallest frame block: 64 bytes
+constexpr unsigned POOL_CLASSES = 12;         // 64 B .. 128 KiB, fits HEADER_LEN + MAX_BODY
+constexpr size_t POOL_CACHE_BYTES = 256 << 10; // per thread, per size class
+constexpr size_t POOL_DEPOT_BYTES = 32 << 20; // shared, per size class
 
 std::atomic<bool> running{true};
-int src_listener = -1;
-int dst_listener = -1;
+std::atomic<unsigned> dump_requests{0}; // SIGUSR1s so far; reactors dump latency to catch up
+std::mutex dump_mu;                     // keeps one reactor's dump together on stderr
+std::atomic<unsigned> scrape_requests{0}; // metrics scrapes so far; reactors post their part
+std::mutex scrape_mu;                     // guards every Reactor::scrape
+std::condition_variable scrape_cv;        // a reactor posted its part
+std::atomic<unsigned> blocked_sinks{0}; // Block-policy sinks over their watermark
+int wake_fd = -1;
+
+enum class IoBackend
+{
+  Epoll,
+  Uring,
+};
+
+// How frames from several sources are interleaved for the destinations.
+enum class SourceOrder
+{
+  Fifo,   // each source's frames in order, sources merged fairly per reactor
+  Global, // one total order: every destination sees the same sequence
+};
+
+// What a destination's listener does when that destination falls behind.
+enum class SlowPolicy
+{
+  Disconnect, // close it once its queue is over the frame/byte watermark
+  DropOldest, // make room by discarding its oldest unsent frames
+  DropNewest, // discard frames that do not fit
+  Block,      // stop reading sources until its queue drains
+};
+
+struct Options
+{
+  unsigned reactors = 0; // 0 = one per core
+  IoBackend io = IoBackend::Epoll;
+  size_t sink_max_frames = 65536;  // queued frames before a sink counts as stalled
+  size_t sink_max_bytes = 8 << 20; // queued bytes before a sink counts as stalled
+  SlowPolicy slow_policy = SlowPolicy::Disconnect;
+  SourceOrder order = SourceOrder::Fifo;
+  ChecksumKernel checksum = ChecksumKernel::Auto;
+  size_t zerocopy_min = 0; // frames this big go out with MSG_ZEROCOPY (0 = never)
+  unsigned channels = 1;   // channel c: sources on SOURCE_PORT + c, destinations on DEST_PORT + c
+  size_t replay_frames = 0;       // history kept per channel for late joiners (0 = none)
+  size_t replay_bytes = 4 << 20;  // and its byte limit
+  const char *journal_dir = nullptr;      // append every delivered frame here (nullptr = off)
+  size_t journal_segment = size_t(256) << 20; // data bytes per journal segment
+  unsigned journal_keep = 16;             // segments kept on disk (0 = all)
+  int admin_port = 0;                     // Prometheus metrics on 127.0.0.1 (0 = off)
+};
+
+Options options;
+
+static void handle_signal(int)
+{
+  running.store(false);
+  if (wake_fd >= 0)
+  {
+    uint64_t one = 1;
+    ssize_t r = write(wake_fd, &one, sizeof(one));
+    (void)r;
+  }
+}
+
+static bool would_block()
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+// Timings of this thread's parsing (header check, allocation and copy)
+// and checksum verification, each for one frame in PARSE_SAMPLE.
+struct ParseStats
+{
+  Histogram parse;
+  Histogram checksum;
+  unsigned tick = 0;          // frames parsed
+  unsigned checksum_tick = 0; // sensitive frames verified
+};
+
+thread_local ParseStats parse_stats;
+
+// What an epoll registration or io_uring user_data points at.
+enum class Kind : uint8_t
+{
+  Wake,
+  Inbox,
+  Cancel,
+  Poller,
+  SrcListener,
+  DstListener,
+  Source,
+  Sink,
+};
+
+struct Conn
+{
+  Kind kind;
+  int fd;
+  unsigned inflight = 0; // io_uring operations still referencing this object
+
+  Conn(Kind k, int f) : kind(k), fd(f) {}
+  virtual ~Conn() = default;
+};
+
+// Frame blocks come in power-of-two size classes. Each thread keeps a free
+// list per class; overflow goes to a shared depot in batches, which is how
+// blocks freed by sink threads find their way back to the source thread.
+struct PoolBlock
+{
+  PoolBlock *next;
+};
+
+struct PoolCache
+{
+  PoolBlock *head[POOL_CLASSES];
+  size_t count[POOL_CLASSES];
+  std::atomic<uint64_t> *hits, *misses; // the owning reactor's Counters; null elsewhere
+};
+
+struct PoolDepot
+{
+  std::mutex mu;
+  PoolBlock *head = nullptr;
+  size_t count = 0;
+};
+
+// Trivially destructible so frames released during static teardown still
+// find it; threads hand their blocks back with pool_flush() instead.
+thread_local PoolCache pool_cache;
+PoolDepot pool_depot[POOL_CLASSES];
+
+// Add n to a counter only the calling thread writes: a plain load and
+// store, no locked instruction.
+static void bump(std::atomic<uint64_t> &c, uint64_t n = 1)
+{
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static unsigned pool_class(size_t n)
+{
+  unsigned c = 0;
+  while ((size_t(1) << (POOL_MIN_SHIFT + c)) < n)
+    ++c;
+  return c;
+}
+
+static constexpr size_t pool_block_size(unsigned c) { return size_t(1) << (POOL_MIN_SHIFT + c); }
+
+// Most blocks a thread or the depot keeps for class c before letting go.
+static size_t pool_cache_cap(unsigned c) { return std::max<size_t>(8, POOL_CACHE_BYTES / pool_block_size(c)); }
+static size_t pool_depot_cap(unsigned c) { return std::max<size_t>(64, POOL_DEPOT_BYTES / pool_block_size(c)); }
+
+// Move up to n blocks from one free list to another.
+static void pool_move(PoolBlock *&from, size_t &from_n, PoolBlock *&to, size_t &to_n, size_t n)
+{
+  for (; n && from; --n)
+  {
+    PoolBlock *b = from;
+    from = b->next;
+    b->next = to;
+    to = b;
+    --from_n;
+    ++to_n;
+  }
+}
+
+static void *pool_alloc(size_t n)
+{
+  const unsigned c = pool_class(n);
+  PoolCache &tc = pool_cache;
+  if (!tc.head[c])
+  {
+    PoolDepot &d = pool_depot[c];
+    std::lock_guard<std::mutex> lk(d.mu);
+    pool_move(d.head, d.count, tc.head[c], tc.count[c], pool_cache_cap(c) / 2);
+  }
+  if (PoolBlock *b = tc.head[c])
+  {
+    tc.head[c] = b->next;
+    --tc.count[c];
+    if (tc.hits)
+      bump(*tc.hits);
+    return b;
+  }
+  if (tc.misses)
+    bump(*tc.misses);
+  return ::operator new(pool_block_size(c));
+}
+
+static void pool_free(void *p, size_t n)
+{
+  const unsigned c = pool_class(n);
+  PoolCache &tc = pool_cache;
+  PoolBlock *b = static_cast<PoolBlock *>(p);
+  b->next = tc.head[c];
+  tc.head[c] = b;
+  if (++tc.count[c] <= pool_cache_cap(c))
+    return;
+
+  // Spill half to the depot; past its cap, back to the heap.
+  PoolDepot &d = pool_depot[c];
+  PoolBlock *spill = nullptr;
+  size_t spill_n = 0;
+  {
+    std::lock_guard<std::mutex> lk(d.mu);
+    size_t room = pool_depot_cap(c) > d.count ? pool_depot_cap(c) - d.count : 0;
+    pool_move(tc.head[c], tc.count[c], d.head, d.count, std::min(room, tc.count[c] / 2));
+  }
+  pool_move(tc.head[c], tc.count[c], spill, spill_n, tc.count[c] - pool_cache_cap(c) / 2);
+  while (spill)
+  {
+    PoolBlock *next = spill->next;
+    ::operator delete(spill);
+    spill = next;
+  }
+}
+
+// Return this thread's cached blocks to the depot (call before it exits).
+static void pool_flush()
+{
+  PoolCache &tc = pool_cache;
+  for (unsigned c = 0; c < POOL_CLASSES; ++c)
+  {
+    PoolDepot &d = pool_depot[c];
+    std::lock_guard<std::mutex> lk(d.mu);
+    pool_move(tc.head[c], tc.count[c], d.head, d.count, tc.count[c]);
+  }
+}
+
+// One CTMP frame, header and body in a single allocation right after this
+// struct. Filled once by the source that reads it (and numbered by the
+// reactor that delivers it), then immutable and shared by every shard,
+// sink queue and history; freed with the last reference.
+struct Frame
+{
+  std::atomic<uint32_t> refs{1};
+  uint32_t len;         // header + body bytes
+  uint32_t channel = 0; // routed only to this channel's destinations
+  uint64_t seq = 0;     // position in its channel, set by the reactor delivering it
+  uint64_t ingress_ns = 0; // now_ns() of the read that completed its header
+
+  static Frame *alloc(size_t len)
+  {
+    void *p = pool_alloc(sizeof(Frame) + len);
+    return new (p) Frame(uint32_t(len));
+  }
+
+  static void release(Frame *f)
+  {
+    const size_t n = sizeof(Frame) + f->len;
+    f->~Frame();
+    pool_free(f, n);
+  }
+
+  uint8_t *data() { return reinterpret_cast<uint8_t *>(this + 1); }
+  const uint8_t *data() const { return reinterpret_cast<const uint8_t *>(this + 1); }
+  size_t size() const { return len; }
+
+private:
+  explicit Frame(uint32_t n) : len(n) {}
+};
+
+static_assert(sizeof(Frame) + HEADER_LEN + MAX_BODY <= pool_block_size(POOL_CLASSES - 1),
+              "largest frame must fit the largest pool class");
+
+// Owning handle to a Frame; copies share it, the last one frees it.
+class FrameRef
+{
+public:
+  FrameRef() = default;
+  explicit FrameRef(Frame *f) : f_(f) {}
+  FrameRef(const FrameRef &o) : f_(o.f_)
+  {
+    if (f_)
+      f_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  FrameRef(FrameRef &&o) noexcept : f_(o.f_) { o.f_ = nullptr; }
+  FrameRef &operator=(FrameRef o) noexcept
+  {
+    std::swap(f_, o.f_);
+    return *this;
+  }
+  ~FrameRef() { reset(); }
+
+  void reset()
+  {
+    if (f_ && f_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      Frame::release(f_);
+    f_ = nullptr;
+  }
+
+  Frame *get() const { return f_; }
+  Frame &operator*() const { return *f_; }
+  Frame *operator->() const { return f_; }
+  explicit operator bool() const { return f_ != nullptr; }
+
+private:
+  Frame *f_ = nullptr;
+};
+
+// A non-blocking source and the CTMP frame it is part-way through sending.
+struct Source : Conn
+{
+  uint8_t hdr[HEADER_LEN];
+  size_t have = 0;          // bytes of the current frame received so far
+  FrameRef msg;    // header + body, complete once have == msg->size()
+  unsigned channel;         // of the listener it connected to
+  uint64_t t0 = 0;          // sampled frame: its header completed at this now_ns()
+  CtmpError error = CtmpError::None; // why its last frame was rejected
+
+  Source(int f, unsigned ch) : Conn(Kind::Source, f), channel(ch) {}
+};
+
+// Bounded FIFO of the frames one sink has not fully written, in arrival
+// order. A power-of-two ring that grows on demand up to max_frames.
+class SinkQueue
+{
+public:
+  bool empty() const { return head_ == tail_; }
+  size_t size() const { return tail_ - head_; }
+  size_t bytes() const { return bytes_; }
+  const FrameRef &front() const { return slot(head_); }
+
+  // Would adding n more bytes cross the frame or byte watermark?
+  bool full_for(size_t n) const
+  {
+    return size() >= options.sink_max_frames || bytes_ + n > options.sink_max_bytes;
+  }
+
+  // Back under half of both watermarks.
+  bool drained() const
+  {
+    return size() <= options.sink_max_frames / 2 && bytes_ <= options.sink_max_bytes / 2;
+  }
+
+  void push(const FrameRef &msg)
+  {
+    if (size() == slots_.size())
+      grow();
+    slot(tail_++) = msg;
+    bytes_ += msg->size();
+  }
+
+  void pop()
+  {
+    FrameRef &m = slot(head_++);
+    bytes_ -= m->size();
+    m.reset();
+  }
+
+  const FrameRef &at(size_t i) const { return slot(head_ + i); }
+
+  // Discard the oldest frame behind the first k, which are already
+  // part-way out (or in flight) and have to finish.
+  void drop_after(size_t k)
+  {
+    FrameRef &victim = slot(head_ + k);
+    bytes_ -= victim->size();
+    for (size_t i = head_ + k; i != head_; --i)
+      slot(i) = std::move(slot(i - 1));
+    ++head_;
+  }
+
+private:
+  FrameRef &slot(size_t i) { return slots_[i & (slots_.size() - 1)]; }
+  const FrameRef &slot(size_t i) const { return slots_[i & (slots_.size() - 1)]; }
+
+  void grow()
+  {
+    std::vector<FrameRef> bigger(std::max<size_t>(8, slots_.size() * 2));
+    for (size_t i = head_; i != tail_; ++i)
+      bigger[(i - head_) & (bigger.size() - 1)] = std::move(slots_[i & (slots_.size() - 1)]);
+    tail_ -= head_;
+    head_ = 0;
+    slots_.swap(bigger);
+  }
+
+  std::vector<FrameRef> slots_;
+  size_t head_ = 0; // both only ever increase; masked on access
+  size_t tail_ = 0;
+  size_t bytes_ = 0;
+};
+
+// A frame the kernel may still be reading from after a MSG_ZEROCOPY send.
+struct ZcHold
+{
+  uint32_t seq; // the send's notification id
+  FrameRef frame;
+};
+
+// What a destination subscribed to. A frame matches when its body starts
+// with one of the prefixes (or none are given) and its LENGTH is within
+// [min_len, max_len]. No prefix extends another one.
+struct Filter
+{
+  std::vector<std::string> prefixes;
+  uint16_t min_len = 0;
+  uint16_t max_len = MAX_BODY;
+
+  bool all() const { return prefixes.empty() && min_len == 0 && max_len == MAX_BODY; }
+};
+
+// Where a late joiner's replay starts.
+struct Replay
+{
+  enum Kind
+  {
+    None,
+    Last,  // the newest n frames held
+    Since, // from the frame numbered n (or the oldest held)
+  } kind = None;
+  uint64_t n = 0;
+};
+
+// A non-blocking destination and the frames the kernel has not taken yet.
+struct Sink : Conn
+{
+  SinkQueue queue;
+  size_t off = 0;        // bytes of queue.front() already written
+  size_t idx = 0;        // position in its channel's Reactor::sinks or filters list
+  unsigned channel;      // subscribed to; fixed by the port it connected to
+  Filter filter;         // from its last subscription frame
+  bool filtered = false; // filter is not all(): listed in Reactor::filters
+  bool joining = false;  // from the replay port, held until its first subscription
+  std::vector<uint8_t> ctl; // subscription frame received so far
+  SlowPolicy policy;
+  uint64_t dropped = 0;  // frames discarded by DropOldest/DropNewest
+  Histogram latency;     // ingress to fully written, per live frame
+  size_t replayed = 0;   // frames at the head of queue from a replay, left out of latency
+  bool blocking = false; // counted in blocked_sinks
+  bool want_out = false; // EPOLLOUT armed (epoll backend)
+  bool pending = false;  // listed in Reactor::pending
+  bool busy = false;     // a send is in flight (io_uring backend)
+  size_t sending = 0;    // frames covered by that send
+  std::vector<iovec> iov; // gathered frames; must outlive an io_uring send
+  msghdr mh{};
+  bool zc = false;             // SO_ZEROCOPY on: large frames use MSG_ZEROCOPY (epoll backend)
+  uint32_t zc_seq = 0;         // id the kernel gives the next zerocopy send
+  std::vector<ZcHold> zc_held; // sent frames awaiting their completion, by seq
+  size_t zc_head = 0;          // first entry of zc_held still held
+
+  Sink(int f, unsigned ch, SlowPolicy p) : Conn(Kind::Sink, f), channel(ch), policy(p) {}
+};
+
+// Recent frames of one channel in the order this reactor's destinations got
+// them, for late joiners. At most options.replay_frames frames and
+// replay_bytes bytes; the buffers are the ones the sink queues share.
+class History
+{
+public:
+  uint64_t begin() const { return head_; } // oldest frame held
+  uint64_t end() const { return tail_; }   // one past the newest
+  const FrameRef &at(uint64_t i) const { return slots_[i & (slots_.size() - 1)]; }
+
+  void push(const FrameRef &msg)
+  {
+    if (slots_.empty())
+    {
+      size_t n = 1;
+      while (n < options.replay_frames)
+        n <<= 1;
+      slots_.resize(n);
+    }
+    if (tail_ - head_ == options.replay_frames)
+      pop();
+    slot(tail_++) = msg;
+    bytes_ += msg->size();
+    while (bytes_ > options.replay_bytes)
+      pop();
+  }
+
+private:
+  FrameRef &slot(uint64_t i) { return slots_[i & (slots_.size() - 1)]; }
+
+  void pop()
+  {
+    FrameRef &m = slot(head_++);
+    bytes_ -= m->size();
+    m.reset();
+  }
+
+  std::vector<FrameRef> slots_; // power of two, allocated with the first frame
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+  size_t bytes_ = 0;
+};
+
+// One channel's destinations that sent a filter, and those filters compiled
+// into a prefix trie plus length buckets. A frame is matched by one walk of
+// the trie along its body and one bucket lookup of its LENGTH, however many
+// filters there are. Rebuilt whenever one of them subscribes or leaves.
+struct FilterIndex
+{
+  struct Hit
+  {
+    Sink *sink;
+    uint16_t min_len, max_len;
+  };
+  struct Node
+  {
+    std::vector<std::pair<uint8_t, uint32_t>> next; // body byte -> child
+    std::vector<Hit> hits;                          // sinks with a prefix ending here
+  };
+
+  std::vector<std::unique_ptr<Sink>> sinks;
+  std::vector<Node> trie;                   // [0] is the root
+  std::vector<uint32_t> bounds;             // bucket b: LENGTH in [bounds[b], bounds[b + 1])
+  std::vector<std::vector<Sink *>> buckets; // sinks with only a length filter, per bucket
+};
+
+// A source or destination listener, the channel of what it accepts and,
+// for destinations, their slow-consumer policy and whether they replay.
+struct Listener : Conn
+{
+  unsigned channel = 0;
+  SlowPolicy policy = SlowPolicy::Disconnect;
+  bool replay = false; // REPLAY_PORT: destinations wait for their subscription
+
+  Listener(Kind k, int f) : Conn(k, f) {}
+};
+
+// Verify the checksum of a complete frame, if it is sensitive
+static bool check_body(const Frame &msg)
+{
+  if (!checksum_ok(msg.data(), msg.data() + HEADER_LEN, msg.size() - HEADER_LEN))
+  {
+    std::cerr << "[!] dropping packet: checksum mismatch\n";
+    return false;
+  }
+  return true;
+}
+
+// Resumable CTMP parser: consumes n received bytes, read at time now, which
+// may hold any number of frames and end partway through one. Whole frames
+// are decoded in batches straight from p; a partial header or frame stays
+// in the Source until the next call. on_frame runs once per valid frame.
+// Returns false on an invalid frame, with s.error set.
+template <typename F>
+static bool feed_ctmp(Source &s, const uint8_t *p, size_t n, uint64_t now, F &&on_frame)
+{
+  // s.msg is complete: verify it and hand it on
+  auto finish = [&]
+  {
+    const bool time_ck = (s.msg->data()[1] & 0x40) && ++parse_stats.checksum_tick % PARSE_SAMPLE == 0;
+    const uint64_t t1 = s.t0 || time_ck ? now_ns() : 0;
+    if (!check_body(*s.msg))
+    {
+      s.error = CtmpError::BadChecksum;
+      return false;
+    }
+    if (s.t0)
+      parse_stats.parse.record(t1 - s.t0);
+    if (time_ck)
+      parse_stats.checksum.record(now_ns() - t1);
+    on_frame();
+    return true;
+  };
+
+  FrameView views[DECODE_BATCH];
+  for (;;)
+  {
+    if (s.have == 0 && n > 0)
+    {
+      // Checksums are left to finish(), which samples their timing. The
+      // header checks happen in the batch: a sampled frame's parse time
+      // starts with its share of it, so the batch is timed whenever it
+      // could hold the next sampled frame.
+      const uint64_t due = PARSE_SAMPLE - parse_stats.tick % PARSE_SAMPLE;
+      const uint64_t t_batch = due <= std::min(DECODE_BATCH, n / HEADER_LEN) ? now_ns() : 0;
+      const DecodeResult d = ctmp_decode_batch(p, n, views, DECODE_BATCH, false);
+      const uint64_t share = t_batch && d.frames ? (now_ns() - t_batch) / d.frames : 0;
+      for (size_t i = 0; i < d.frames; ++i)
+      {
+        s.t0 = ++parse_stats.tick % PARSE_SAMPLE == 0 ? now_ns() - share : 0;
+        s.msg = FrameRef(Frame::alloc(views[i].len));
+        s.msg->channel = s.channel;
+        s.msg->ingress_ns = now;
+        std::memcpy(s.msg->data(), p + views[i].offset, views[i].len);
+        if (!finish())
+          return false;
+      }
+      p += d.used;
+      n -= d.used;
+      if (d.error == CtmpError::None)
+        continue; // out of views, or of bytes
+      if (d.error != CtmpError::ShortRead)
+      {
+        s.error = d.error;
+        return false;
+      }
+    }
+
+    // The rest is one frame split across reads.
+    if (s.have < HEADER_LEN)
+    {
+      const size_t k = std::min(n, HEADER_LEN - s.have);
+      std::memcpy(s.hdr + s.have, p, k);
+      s.have += k;
+      p += k;
+      n -= k;
+      if (s.have < HEADER_LEN)
+        return true;
+
+      s.t0 = ++parse_stats.tick % PARSE_SAMPLE == 0 ? now_ns() : 0;
+      uint16_t len;
+      if ((s.error = check_header(s.hdr, len)) != CtmpError::None)
+        return false;
+      s.msg = FrameRef(Frame::alloc(HEADER_LEN + len));
+      s.msg->channel = s.channel;
+      s.msg->ingress_ns = now;
+      std::memcpy(s.msg->data(), s.hdr, HEADER_LEN);
+    }
+
+    const size_t k = std::min(n, s.msg->size() - s.have);
+    std::memcpy(s.msg->data() + s.have, p, k);
+    s.have += k;
+    p += k;
+    n -= k;
+    if (s.have < s.msg->size())
+    {
+      s.t0 = 0; // the rest comes in a later read: not parse time
+      return true;
+    }
+
+    s.have = 0;
+    if (!finish())
+      return false;
+  }
+}
+
+// Minimal io_uring over the raw syscalls: one SQ/CQ pair per reactor and a
+// provided-buffer ring that multishot recv fills.
+struct Uring
+{
+  int fd = -1;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+  unsigned sq_entries;
+  unsigned sqe_tail = 0;      // next SQE to hand out
+  unsigned sqe_submitted = 0; // SQEs already passed to io_uring_enter
+
+  // Provided buffer ring, registered by setup_uring(). Indexed as a plain
+  // array: io_uring_buf_ring::bufs is misplaced when the header is built as
+  // C++ (its empty-struct member has size 1). The tail lives in br[0].resv.
+  io_uring_buf *br = nullptr;
+  uint8_t *bufs = nullptr;
+  unsigned br_tail = 0;
+};
+
+static bool uring_init(Uring &u)
+{
+  io_uring_params p{};
+  p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+  p.cq_entries = URING_CQ_ENTRIES;
+  u.fd = int(syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p));
+  if (u.fd < 0 && errno == EINVAL)
+  {
+    p = io_uring_params{};
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+    u.fd = int(syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &p));
+  }
+  if (u.fd < 0)
+    return false;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP))
+  {
+    errno = ENOTSUP;
+    return false;
+  }
+
+  const size_t ring_sz = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                                  p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+  auto *ring = static_cast<uint8_t *>(mmap(nullptr, ring_sz, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, u.fd, IORING_OFF_SQ_RING));
+  void *sqes = mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u.fd, IORING_OFF_SQES);
+  if (ring == MAP_FAILED || sqes == MAP_FAILED)
+    return false;
+
+  u.sq_head = reinterpret_cast<unsigned *>(ring + p.sq_off.head);
+  u.sq_tail = reinterpret_cast<unsigned *>(ring + p.sq_off.tail);
+  u.sq_mask = reinterpret_cast<unsigned *>(ring + p.sq_off.ring_mask);
+  u.sq_array = reinterpret_cast<unsigned *>(ring + p.sq_off.array);
+  u.cq_head = reinterpret_cast<unsigned *>(ring + p.cq_off.head);
+  u.cq_tail = reinterpret_cast<unsigned *>(ring + p.cq_off.tail);
+  u.cq_mask = reinterpret_cast<unsigned *>(ring + p.cq_off.ring_mask);
+  u.cqes = reinterpret_cast<io_uring_cqe *>(ring + p.cq_off.cqes);
+  u.sqes = static_cast<io_uring_sqe *>(sqes);
+  u.sq_entries = p.sq_entries;
+  u.sqe_tail = u.sqe_submitted = *u.sq_tail;
+  return true;
+}
+
+// Submit queued SQEs, optionally waiting for at least one completion.
+static void uring_enter(Uring &u, bool wait)
+{
+  __atomic_store_n(u.sq_tail, u.sqe_tail, __ATOMIC_RELEASE);
+  const unsigned n = u.sqe_tail - u.sqe_submitted;
+  int ret = int(syscall(__NR_io_uring_enter, u.fd, n, wait ? 1 : 0,
+                        wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+  if (ret >= 0)
+    u.sqe_submitted += unsigned(ret);
+  else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+    perror("io_uring_enter");
+}
+
+static io_uring_sqe *uring_sqe(Uring &u)
+{
+  while (u.sqe_tail - __atomic_load_n(u.sq_head, __ATOMIC_ACQUIRE) >= u.sq_entries)
+    uring_enter(u, false); // SQ full: let the kernel consume it first
+
+  const unsigned i = u.sqe_tail & *u.sq_mask;
+  io_uring_sqe *sqe = &u.sqes[i];
+  std::memset(sqe, 0, sizeof(*sqe));
+  u.sq_array[i] = i;
+  ++u.sqe_tail;
+  return sqe;
+}
+
+// Give buffer bid back to the kernel for the next multishot completion.
+static void uring_recycle(Uring &u, unsigned bid)
+{
+  io_uring_buf &b = u.br[u.br_tail & (RECV_BUFS - 1)];
+  b.addr = reinterpret_cast<uint64_t>(u.bufs + size_t(bid) * RECV_BUF_SIZE);
+  b.len = RECV_BUF_SIZE;
+  b.bid = uint16_t(bid);
+  ++u.br_tail;
+  __atomic_store_n(&u.br[0].resv, uint16_t(u.br_tail), __ATOMIC_RELEASE);
+}
+
+static bool uring_setup_bufs(Uring &u)
+{
+  void *br = mmap(nullptr, RECV_BUFS * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  void *bufs = mmap(nullptr, size_t(RECV_BUFS) * RECV_BUF_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (br == MAP_FAILED || bufs == MAP_FAILED)
+    return false;
+
+  io_uring_buf_reg reg{};
+  reg.ring_addr = reinterpret_cast<uint64_t>(br);
+  reg.ring_entries = RECV_BUFS;
+  reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+  {
+    perror("IORING_REGISTER_PBUF_RING");
+    return false;
+  }
+
+  u.br = static_cast<io_uring_buf *>(br);
+  u.bufs = static_cast<uint8_t *>(bufs);
+  for (unsigned bid = 0; bid < RECV_BUFS; ++bid)
+    uring_recycle(u, bid);
+  return true;
+}
+
+// Multishot recv needs Linux 6.0+ (provided buffer rings 5.19+).
+static bool uring_supported()
+{
+  utsname un{};
+  int major = 0;
+  if (uname(&un) < 0 || std::sscanf(un.release, "%d.", &major) != 1)
+    return false;
+  return major >= 6;
+}
+
+// How other threads get a reactor's attention. conn.fd is an eventfd that
+// wakes it for new frames in its peers' broadcast rings, backpressure
+// changes, and latency dump and metrics scrape requests. Under Global
+// order the sequencer's inbox also carries the other reactors' frames for
+// it to place.
+struct Inbox
+{
+  Conn conn{Kind::Inbox, -1};
+  std::mutex mu;
+  std::vector<FrameRef> unordered; // Global order: frames for the sequencer to place
+  std::atomic<bool> full{false};   // unordered reached UNORDERED_MAX: the others pause
+};
+
+// One reader's position in a BroadcastRing, on a cache line of its own.
+struct alignas(64) RingCursor
+{
+  std::atomic<uint64_t> pos{0};    // next frame to read; the reader advances it
+  std::atomic<bool> active{false}; // reading: the producer keeps frames from pos on
+  std::atomic<bool> join{false};   // reader wants to start at the next publish
+  uint64_t max_lag = 0;            // most frames it has found itself behind
+};
+
+// Single-producer, multi-consumer broadcast ring. The owning reactor
+// publishes the frames it delivered; every other reactor with destinations
+// reads them through its own cursor. Publishing is plain slot writes and
+// one store of head; nobody takes a lock. The producer clears slots once
+// every active reader is past them.
+struct BroadcastRing
+{
+  alignas(64) std::atomic<uint64_t> head{0}; // next slot to fill
+  std::atomic<bool> stalled{false};          // full: readers wake the producer as they advance
+  alignas(64) uint64_t reclaimed = 0;        // slots before this are empty (producer only)
+  std::vector<FrameRef> slots;               // BROADCAST_SLOTS, allocated with peers
+  std::unique_ptr<RingCursor[]> cursors;     // one per reactor
+
+  FrameRef &slot(uint64_t i) { return slots[i & (BROADCAST_SLOTS - 1)]; }
+};
+
+// Single-producer, single-consumer hand-off from a reactor to the journal
+// writer, laid out like a BroadcastRing with one reader. A full queue
+// never holds the reactor up: the frames that do not fit are left out of
+// the journal and counted in Counters::journal_drops.
+struct JournalQueue
+{
+  alignas(64) std::atomic<uint64_t> head{0}; // next slot to fill
+  uint64_t reclaimed = 0;                    // slots before this are empty (reactor only)
+  alignas(64) std::atomic<uint64_t> tail{0}; // next frame to write; the writer advances it
+  uint64_t max_lag = 0;                      // most frames the writer has found itself behind
+  std::vector<FrameRef> slots;               // JOURNAL_SLOTS, allocated with the journal
+
+  FrameRef &slot(uint64_t i) { return slots[i & (JOURNAL_SLOTS - 1)]; }
+};
+
+// Traffic totals of one reactor. Only its thread writes them, with a plain
+// load and store rather than a locked add; the admin thread sums them
+// across reactors when scraped.
+struct alignas(64) Counters
+{
+  std::atomic<uint64_t> frames_in{0}, bytes_in{0};   // valid frames read from sources
+  std::atomic<uint64_t> frames_out{0}, bytes_out{0}; // fully written, per destination
+  std::atomic<uint64_t> rejected[CTMP_ERRORS] = {};  // sources closed, by CtmpError
+  std::atomic<uint64_t> queue_drops{0};              // DropOldest/DropNewest
+  std::atomic<uint64_t> slow_disconnects{0};         // Disconnect policy
+  std::atomic<uint64_t> journal_drops{0};            // not journaled: its queue was full
+  std::atomic<uint64_t> pool_hits{0};                // frame buffers from a thread or depot free list
+  std::atomic<uint64_t> pool_misses{0};              // frame buffers from operator new
+};
+
+// One destination as a scrape sees it.
+struct SinkSample
+{
+  std::string peer;
+  unsigned channel;
+  size_t queue_frames, queue_bytes;
+  uint64_t dropped;
+  uint64_t written;       // frames
+  uint64_t latency[4];    // ns, at SCRAPE_QUANTILES
+};
+
+constexpr double SCRAPE_QUANTILES[4] = {0.5, 0.9, 0.99, 0.999};
+
+// A reactor's answer to a scrape: what only its own thread can read.
+struct ScrapePart
+{
+  unsigned gen = 0; // scrape_requests this answers
+  std::vector<SinkSample> sinks;
+  size_t sources = 0;
+  Histogram latency; // all destinations, including those that have left
+  Histogram parse, checksum;
+};
+
+// One event loop per thread. Each owns a SO_REUSEPORT slice of the
+// destinations and of the sources. With SourceOrder::Global, reactor 0 is
+// also the sequencer: the others parse and validate their sources' frames
+// but pass them to it, and only it broadcasts.
+// With the io_uring backend, readiness still comes from epfd (polled through
+// the ring), while source reads and sink sends go through the ring.
+struct Reactor
+{
+  unsigned id = 0; // index in reactors
+  int epfd = -1;
+  Conn wake{Kind::Wake, -1};
+  Conn poller{Kind::Poller, -1};
+  Conn cancel{Kind::Cancel, -1};
+  std::vector<std::unique_ptr<Listener>> src_accept; // per channel
+  std::vector<std::unique_ptr<Listener>> dst_accept; // per channel
+  std::vector<std::unique_ptr<Listener>> rpl_accept; // per channel, with replay on
+  Inbox inbox;
+  BroadcastRing bcast;
+  JournalQueue journal_q;
+  std::unique_ptr<Uring> ring;
+  std::vector<FrameRef> outbox; // frames read this round, not yet handed to peers and journal
+  std::vector<FrameRef> to_sequencer; // frames read this round, not yet ordered (Global)
+  std::vector<uint8_t> rx;      // receive buffer shared by this reactor's sources (epoll)
+  std::vector<std::unique_ptr<Source>> sources;
+  bool sources_paused = false; // backpressure: see must_pause()
+  std::vector<std::vector<std::unique_ptr<Sink>>> sinks; // per channel: its subscribers
+  std::vector<FilterIndex> filters;                      // per channel: subscribers with a filter
+  std::vector<std::unique_ptr<Sink>> joining;            // replay port, not subscribed yet
+  unsigned nsinks = 0;                                   // across all channels
+  std::vector<History> history;                          // per channel, with replay on
+  std::vector<uint64_t> next_seq;                        // per channel: number of the next frame delivered
+  std::vector<Sink *> matched;                           // scratch for broadcast_filtered
+  std::vector<Sink *> pending; // sinks queued to since the last flush
+  std::vector<std::unique_ptr<Conn>> dead; // closed, freed once nothing is in flight
+  Histogram departed; // latency of the destinations that have left
+  unsigned dumped = 0; // dump_requests served
+  Counters counters;
+  unsigned scraped = 0; // scrape_requests served
+  ScrapePart scrape;    // under scrape_mu
+};
+
+std::vector<std::unique_ptr<Reactor>> reactors;
+
+
+// One journal record's index entry.
+struct JournalEntry
+{
+  uint64_t offset;  // of the frame in the segment's data file
+  uint64_t seq;     // Frame::seq
+  uint64_t time_ns; // CLOCK_REALTIME when it was journaled
+  uint32_t channel;
+  uint32_t len;     // header + body bytes
+};
+
+// Append-only journal of every delivered frame, written by its own thread,
+// which takes them from every reactor's JournalQueue. A
+// segment is a pair of files: journal-N.ctmp holds the frames back to back
+// (itself a CTMP stream) and journal-N.idx one JournalEntry per frame.
+// Both are preallocated and mapped; the segment rolls when either is full.
+struct Journal
+{
+  int efd = -1;  // eventfd: publish() wakes the writer through it
+  uint64_t segment = 0;         // number of the open segment
+  std::vector<uint64_t> on_disk; // segment numbers, oldest first
+  int data_fd = -1, idx_fd = -1;
+  uint8_t *data = nullptr;
+  JournalEntry *idx = nullptr;
+  size_t data_used = 0, idx_used = 0, idx_cap = 0;
+  size_t data_synced = 0, idx_synced = 0;
+  uint64_t frames = 0, bytes = 0;
+  std::atomic<bool> stop{false}; // set once the reactors are done: drain and exit
+  std::atomic<bool> failed{false}; // a write failed: the reactors stop queueing
+};
+
+std::unique_ptr<Journal> journal;
+
+static void watch(Reactor &r, Conn &c, uint32_t events, int op = EPOLL_CTL_ADD)
+{
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.ptr = &c;
+  if (epoll_ctl(r.epfd, op, c.fd, &ev) < 0)
+    perror("epoll_ctl");
+}
+
+// Close c's fd. Under io_uring, shut the socket down first so operations
+// still in flight on it complete promptly.
+static void close_conn(Conn &c)
+{
+  if (c.inflight > 0)
+    shutdown(c.fd, SHUT_RDWR);
+  close(c.fd);
+  c.fd = -1;
+}
+
+static void drop_source(Reactor &r, Source &s)
+{
+  if (s.error == CtmpError::None && s.have > 0)
+    s.error = CtmpError::ShortRead;
+  if (s.error != CtmpError::None)
+    bump(r.counters.rejected[unsigned(s.error)]);
+  close_conn(s);
+  for (auto it = r.sources.begin(); it != r.sources.end(); ++it)
+  {
+    if (it->get() == &s)
+    {
+      r.dead.push_back(std::move(*it));
+      r.sources.erase(it);
+      break;
+    }
+  }
+}
+
+// SIGUSR1: every reactor prints its latency histograms from its own thread.
+static void handle_dump(int)
+{
+  dump_requests.fetch_add(1);
+  for (auto &r : reactors)
+  {
+    uint64_t one = 1;
+    ssize_t n = write(r->inbox.conn.fd, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+// Wake every reactor (each may own sources) so it re-checks backpressure.
+static void wake_sources()
+{
+  for (auto &r : reactors)
+  {
+    uint64_t one = 1;
+    ssize_t n = write(r->inbox.conn.fd, &one, sizeof(one));
+    (void)n;
+  }
+}
+
+static void set_blocking(Sink &d, bool on)
+{
+  if (d.blocking == on)
+    return;
+  d.blocking = on;
+  if (on)
+    blocked_sinks.fetch_add(1);
+  else if (blocked_sinks.fetch_sub(1) == 1)
+    wake_sources();
+}
+
+// The list of r's destinations that d is in.
+static std::vector<std::unique_ptr<Sink>> &sink_list(Reactor &r, const Sink &d)
+{
+  if (d.joining)
+    return r.joining;
+  return d.filtered ? r.filters[d.channel].sinks : r.sinks[d.channel];
+}
+
+static void list_sink(Reactor &r, std::unique_ptr<Sink> d)
+{
+  auto &subs = sink_list(r, *d);
+  d->idx = subs.size();
+  subs.push_back(std::move(d));
+}
+
+static std::unique_ptr<Sink> unlist_sink(Reactor &r, Sink &d)
+{
+  auto &subs = sink_list(r, d);
+  const size_t i = d.idx;
+  std::unique_ptr<Sink> p = std::move(subs[i]);
+  if (i + 1 != subs.size())
+  {
+    subs[i] = std::move(subs.back());
+    subs[i]->idx = i;
+  }
+  subs.pop_back();
+  return p;
+}
+
+// Rebuild the trie and length buckets from the filters of fx.sinks.
+static void compile_filters(FilterIndex &fx)
+{
+  fx.trie.assign(1, FilterIndex::Node{});
+  fx.bounds.clear();
+  fx.buckets.clear();
+  for (auto &d : fx.sinks)
+  {
+    const Filter &f = d->filter;
+    if (f.prefixes.empty())
+    {
+      fx.bounds.push_back(f.min_len);
+      fx.bounds.push_back(f.max_len + 1u);
+    }
+    for (const std::string &prefix : f.prefixes)
+    {
+      uint32_t n = 0;
+      for (unsigned char c : prefix)
+      {
+        auto &next = fx.trie[n].next;
+        auto it = std::find_if(next.begin(), next.end(), [c](const auto &e) { return e.first == c; });
+        if (it != next.end())
+        {
+          n = it->second;
+          continue;
+        }
+        next.emplace_back(c, uint32_t(fx.trie.size()));
+        n = uint32_t(fx.trie.size());
+        fx.trie.emplace_back(); // invalidates next
+      }
+      fx.trie[n].hits.push_back({d.get(), f.min_len, f.max_len});
+    }
+  }
+
+  std::sort(fx.bounds.begin(), fx.bounds.end());
+  fx.bounds.erase(std::unique(fx.bounds.begin(), fx.bounds.end()), fx.bounds.end());
+  fx.buckets.resize(fx.bounds.size());
+  for (auto &d : fx.sinks)
+  {
+    const Filter &f = d->filter;
+    if (!f.prefixes.empty())
+      continue;
+    auto b = std::lower_bound(fx.bounds.begin(), fx.bounds.end(), f.min_len);
+    for (; b != fx.bounds.end() && *b <= f.max_len; ++b)
+      fx.buckets[b - fx.bounds.begin()].push_back(d.get());
+  }
+}
+
+static void drop_sink(Reactor &r, Sink &d)
+{
+  if (d.zc_head < d.zc_held.size())
+  {
+    // Frames still pinned by MSG_ZEROCOPY go back to the pool with d. Reset
+    // the connection so the kernel discards the send queue rather than
+    // transmitting their pages after the next Frame::alloc reuses them.
+    linger lg{1, 0};
+    setsockopt(d.fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  }
+  close_conn(d);
+  set_blocking(d, false);
+  if (d.dropped > 0)
+    std::cerr << "[!] destination closed after dropping " << d.dropped << " frames\n";
+  r.departed.merge(d.latency);
+  r.dead.push_back(unlist_sink(r, d));
+  if (d.filtered)
+    compile_filters(r.filters[d.channel]);
+  --r.nsinks;
+}
+
+// Replace d's filter, moving it between the plain and filtered lists
+// (and, for a late joiner, off the joining list).
+static void subscribe(Reactor &r, Sink &d, Filter f)
+{
+  const bool was = d.filtered;
+  const bool now = !f.all();
+  d.filter = std::move(f);
+  if (was != now || d.joining)
+  {
+    std::unique_ptr<Sink> p = unlist_sink(r, d);
+    d.filtered = now;
+    d.joining = false;
+    list_sink(r, std::move(p));
+  }
+  if (was || now)
+    compile_filters(r.filters[d.channel]);
+}
+
+// Account for n bytes from the queue head onwards reaching the kernel, and
+// record the latency of every frame that is now fully written.
+static void sink_advance(Reactor &r, Sink &d, size_t n)
+{
+  d.off += n;
+  uint64_t now = 0, frames = 0, bytes = 0;
+  while (!d.queue.empty() && d.off >= d.queue.front()->size())
+  {
+    const Frame &m = *d.queue.front();
+    if (d.replayed > 0)
+      --d.replayed; // its time in the history is not latency
+    else
+    {
+      if (now == 0)
+        now = now_ns();
+      d.latency.record(now - std::min(now, m.ingress_ns));
+    }
+    ++frames;
+    bytes += m.size();
+    d.off -= m.size();
+    d.queue.pop();
+  }
+  if (frames > 0)
+  {
+    bump(r.counters.frames_out, frames);
+    bump(r.counters.bytes_out, bytes);
+  }
+  if (d.blocking && d.queue.drained())
+    set_blocking(d, false);
+}
+
+// Point d.iov at the queued frames, in order, up to SINK_IOV_MAX frames and
+// SINK_SEND_BYTES (the first frame always goes). Returns the total bytes.
+// With zc set, frames of at least options.zerocopy_min are never mixed with
+// smaller ones in a write; *zc then says which kind was gathered.
+static size_t sink_gather(Sink &d, bool *zc = nullptr)
+{
+  const size_t max = std::min(SINK_IOV_MAX, d.queue.size());
+  if (d.iov.size() < max)
+    d.iov.resize(max);
+  size_t cnt = 0, bytes = 0;
+  for (; cnt < max; ++cnt)
+  {
+    const Frame &m = *d.queue.at(cnt);
+    const size_t skip = cnt == 0 ? d.off : 0;
+    if (cnt > 0 && bytes + m.size() > SINK_SEND_BYTES)
+      break;
+    if (zc)
+    {
+      const bool big = m.size() >= options.zerocopy_min;
+      if (cnt == 0)
+        *zc = big;
+      else if (big != *zc)
+        break;
+    }
+    d.iov[cnt].iov_base = const_cast<uint8_t *>(m.data() + skip);
+    d.iov[cnt].iov_len = m.size() - skip;
+    bytes += m.size() - skip;
+  }
+  d.mh = msghdr{};
+  d.mh.msg_iov = d.iov.data();
+  d.mh.msg_iovlen = cnt;
+  d.sending = cnt;
+  return bytes;
+}
+
+// Start an io_uring sendmsg of the gathered queue; its completion sends the rest.
+static void uring_send(Reactor &r, Sink &d)
+{
+  sink_gather(d);
+  io_uring_sqe *sqe = uring_sqe(*r.ring);
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = d.fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&d.mh);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = reinterpret_cast<uint64_t>(static_cast<Conn *>(&d));
+  d.busy = true;
+  ++d.inflight;
+}
+
+// Keep the frames covering the first n bytes of the queue until the kernel
+// reports the zerocopy send that took them as complete.
+static void zc_hold(Sink &d, size_t n)
+{
+  size_t off = d.off;
+  for (size_t i = 0; n > 0; ++i)
+  {
+    const FrameRef &f = d.queue.at(i);
+    const size_t k = std::min(n, f->size() - off);
+    d.zc_held.push_back({d.zc_seq, f});
+    n -= k;
+    off = 0;
+  }
+  ++d.zc_seq;
+}
+
+// Release the frames of zerocopy sends lo..hi (inclusive, wrapping).
+static void zc_release(Sink &d, uint32_t lo, uint32_t hi)
+{
+  for (size_t i = d.zc_head; i < d.zc_held.size(); ++i)
+  {
+    ZcHold &h = d.zc_held[i];
+    if (int32_t(h.seq - lo) >= 0 && int32_t(hi - h.seq) >= 0)
+      h.frame.reset();
+  }
+  while (d.zc_head < d.zc_held.size() && !d.zc_held[d.zc_head].frame)
+    ++d.zc_head;
+  if (d.zc_head == d.zc_held.size())
+  {
+    d.zc_held.clear();
+    d.zc_head = 0;
+  }
+}
+
+// Drain the socket error queue: zerocopy completions release their frames.
+// If the kernel had to copy anyway (e.g. loopback), stop asking for zerocopy
+// on this sink. False means the socket has a real error.
+static bool reap_errqueue(Sink &d)
+{
+  for (;;)
+  {
+    alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(sock_extended_err)) + 64];
+    msghdr mh{};
+    mh.msg_control = ctrl;
+    mh.msg_controllen = sizeof(ctrl);
+    if (recvmsg(d.fd, &mh, MSG_ERRQUEUE) < 0)
+      break;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c))
+    {
+      if (!(c->cmsg_level == SOL_IP && c->cmsg_type == IP_RECVERR) &&
+          !(c->cmsg_level == SOL_IPV6 && c->cmsg_type == IPV6_RECVERR))
+        continue;
+      const auto *ee = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(c));
+      if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0)
+        return false;
+      zc_release(d, ee->ee_info, ee->ee_data);
+      if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+        d.zc = false;
+    }
+  }
+
+  int err = 0;
+  socklen_t len = sizeof(err);
+  return getsockopt(d.fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+}
+
+// Write what the kernel will take, many frames per sendmsg; false means
+// the sink is gone.
+static bool flush_sink(Reactor &r, Sink &d)
+{
+  if (r.ring)
+  {
+    if (!d.busy && !d.queue.empty())
+      uring_send(r, d);
+    return true;
+  }
+
+  while (!d.queue.empty())
+  {
+    bool zc = false;
+    const size_t want = sink_gather(d, d.zc ? &zc : nullptr);
+    ssize_t n = sendmsg(d.fd, &d.mh, MSG_NOSIGNAL | (zc ? MSG_ZEROCOPY : 0));
+    if (n < 0 && zc && errno == ENOBUFS)
+      n = sendmsg(d.fd, &d.mh, MSG_NOSIGNAL); // out of pinned-page budget
+    else if (n > 0 && zc)
+      zc_hold(d, size_t(n));
+    d.sending = 0;
+    if (n < 0)
+    {
+      if (!would_block())
+        return false;
+      break;
+    }
+    sink_advance(r, d, size_t(n));
+    if (size_t(n) < want)
+      break; // socket buffer full; EPOLLOUT picks it up
+  }
+
+  const bool want_out = !d.queue.empty();
+  if (want_out != d.want_out)
+  {
+    d.want_out = want_out;
+    watch(r, d, EPOLLIN | EPOLLRDHUP | (want_out ? uint32_t(EPOLLOUT) : 0u), EPOLL_CTL_MOD);
+  }
+  return true;
+}
+
+// Queue msg behind the sink's backlog; flush_pending() writes it out with
+// the rest of the round's frames. Over the watermark (even after a flush)
+// the sink's policy decides; false means disconnect it.
+static bool sink_write(Reactor &r, Sink &d, const FrameRef &msg);
+
+// The per-destination form of what FilterIndex answers for all of them.
+static bool filter_matches(const Filter &f, const Frame &msg)
+{
+  const size_t len = msg.size() - HEADER_LEN;
+  if (len < f.min_len || len > f.max_len)
+    return false;
+  if (f.prefixes.empty())
+    return true;
+  for (const std::string &p : f.prefixes)
+    if (p.size() <= len && std::memcmp(msg.data() + HEADER_LEN, p.data(), p.size()) == 0)
+      return true;
+  return false;
+}
+
+// Queue the frames a late joiner asked for ahead of any live one. They fit:
+// the history is no bigger than a sink queue, and d's queue is empty.
+static bool replay(Reactor &r, Sink &d, const Replay &from)
+{
+  const History &h = r.history[d.channel];
+  uint64_t i = h.begin();
+  if (from.kind == Replay::Last)
+    i = h.end() - std::min<uint64_t>(from.n, h.end() - h.begin());
+  else if (h.begin() != h.end()) // numbered without gaps (total order only)
+    i += std::min<uint64_t>(from.n - std::min(from.n, h.at(i)->seq), h.end() - i);
+  for (; i != h.end(); ++i)
+    if (filter_matches(d.filter, *h.at(i)) && !sink_write(r, d, h.at(i)))
+      return false;
+  d.replayed = d.queue.size();
+  return true;
+}
+
+static bool sink_write(Reactor &r, Sink &d, const FrameRef &msg)
+{
+  if (d.queue.full_for(msg->size()) && !flush_sink(r, d))
+    return false;
+  if (d.queue.full_for(msg->size()))
+  {
+    switch (d.policy)
+    {
+    case SlowPolicy::Disconnect:
+      bump(r.counters.slow_disconnects);
+      return false;
+    case SlowPolicy::DropNewest:
+      ++d.dropped;
+      bump(r.counters.queue_drops);
+      return true;
+    case SlowPolicy::DropOldest:
+    {
+      // Frames part-way out (or in flight) have to finish.
+      const size_t keep = d.busy ? d.sending : d.off > 0 ? 1 : 0;
+      while (d.queue.size() > keep && d.queue.full_for(msg->size()))
+      {
+        if (keep > 0)
+          d.queue.drop_after(keep);
+        else
+          d.queue.pop();
+        if (d.replayed > keep)
+          --d.replayed; // the dropped frame was one of them
+        ++d.dropped;
+        bump(r.counters.queue_drops);
+      }
+      break;
+    }
+    case SlowPolicy::Block:
+      set_blocking(d, true); // frames already read are still queued
+      break;
+    }
+  }
+  d.queue.push(msg);
+  if (!d.pending)
+  {
+    d.pending = true;
+    r.pending.push_back(&d);
+  }
+  return true;
+}
+
+// Write out every sink queued to this round, one gathered write each.
+// Sinks dropped meanwhile sit in r.dead, so the pointers are still valid.
+static void flush_pending(Reactor &r)
+{
+  for (Sink *d : r.pending)
+  {
+    d->pending = false;
+    if (d->fd >= 0 && !flush_sink(r, *d))
+      drop_sink(r, *d);
+  }
+  r.pending.clear();
+}
+
+// Queue msg to the filtered destinations it matches: those in the length
+// bucket of its LENGTH, and those with a prefix on its path through the
+// trie whose length range holds it.
+static void broadcast_filtered(Reactor &r, FilterIndex &fx, const FrameRef &msg)
+{
+  const uint8_t *body = msg->data() + HEADER_LEN;
+  const size_t len = msg->size() - HEADER_LEN;
+  std::vector<Sink *> &out = r.matched;
+  out.clear();
+
+  auto b = std::upper_bound(fx.bounds.begin(), fx.bounds.end(), len);
+  if (b != fx.bounds.begin())
+  {
+    const auto &bucket = fx.buckets[b - fx.bounds.begin() - 1];
+    out.insert(out.end(), bucket.begin(), bucket.end());
+  }
+  for (size_t i = 0, n = 0;; ++i)
+  {
+    const FilterIndex::Node &node = fx.trie[n];
+    for (const FilterIndex::Hit &h : node.hits)
+      if (len >= h.min_len && len <= h.max_len)
+        out.push_back(h.sink);
+    if (i == len)
+      break;
+    auto it = std::find_if(node.next.begin(), node.next.end(),
+                           [c = body[i]](const auto &e) { return e.first == c; });
+    if (it == node.next.end())
+      break;
+    n = it->second;
+  }
+
+  // Safe to iterate while dropping: that recompiles fx but never touches
+  // r.matched, and the dropped sink lives on in r.dead.
+  for (Sink *d : out)
+    if (!sink_write(r, *d, msg))
+      drop_sink(r, *d);
+}
+
+// Queue msg to the destinations subscribed to its channel.
+static void broadcast(Reactor &r, const FrameRef &msg)
+{
+  if (options.replay_frames > 0)
+    r.history[msg->channel].push(msg);
+
+  auto &subs = r.sinks[msg->channel];
+  for (size_t i = 0; i < subs.size();)
+  {
+    Sink &d = *subs[i];
+    if (sink_write(r, d, msg))
+      ++i;
+    else
+      drop_sink(r, d); // moves the last sink into slot i
+  }
+
+  FilterIndex &fx = r.filters[msg->channel];
+  if (!fx.sinks.empty())
+    broadcast_filtered(r, fx, msg);
+}
+
+// Deliver m locally and queue it for the peers and the journal (publish()
+// drops it if nobody reads the ring).
+static void deliver(Reactor &r, FrameRef m)
+{
+  m->seq = r.next_seq[m->channel]++;
+  broadcast(r, m);
+  if (r.bcast.cursors || journal)
+    r.outbox.push_back(std::move(m));
+}
+
+// A frame just completed on s: deliver it, or under Global order leave
+// its place in the sequence to the sequencer (reactor 0).
+static void on_frame(Reactor &r, Source &s)
+{
+  bump(r.counters.frames_in);
+  bump(r.counters.bytes_in, s.msg->size());
+  if (options.order == SourceOrder::Global && r.id != 0)
+    r.to_sequencer.push_back(std::move(s.msg));
+  else
+    deliver(r, std::move(s.msg));
+}
+
+static void uring_recv(Reactor &r, Source &s);
+
+// Should r stop reading its sources? While a Block-policy sink is over its
+// watermark, while frames wait behind r's full broadcast ring, and under
+// Global order while the sequencer's ring is full or its inbox backed up.
+static bool must_pause(const Reactor &r)
+{
+  if (blocked_sinks.load(std::memory_order_relaxed) > 0 || r.bcast.stalled.load(std::memory_order_relaxed))
+    return true;
+  if (options.order != SourceOrder::Global || r.id == 0)
+    return false;
+  const Reactor &seq = *reactors[0];
+  return seq.bcast.stalled.load(std::memory_order_relaxed) || seq.inbox.full.load(std::memory_order_relaxed);
+}
+
+static void resume_sources(Reactor &r)
+{
+  r.sources_paused = false;
+  for (auto &s : r.sources)
+  {
+    if (!r.ring)
+      watch(r, *s, EPOLLIN, EPOLL_CTL_MOD);
+    else if (s->inflight == 0)
+      uring_recv(r, *s); // else the cancelled recv re-arms on completion
+  }
+}
+
+// Stop reading sources while must_pause(r); apply_backpressure() resumes them.
+static void pause_sources(Reactor &r)
+{
+  r.sources_paused = true;
+  for (auto &s : r.sources)
+  {
+    if (!r.ring)
+    {
+      watch(r, *s, 0, EPOLL_CTL_MOD);
+      continue;
+    }
+    io_uring_sqe *sqe = uring_sqe(*r.ring); // ends the multishot recv
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = reinterpret_cast<uint64_t>(static_cast<Conn *>(s.get()));
+    sqe->user_data = reinterpret_cast<uint64_t>(&r.cancel);
+  }
+}
+
+// Read as much as the kernel has in one recv and parse every frame in it.
+// Nothing is kept in rx between calls, so one buffer serves all sources.
+static void on_source(Reactor &r, Source &s)
+{
+  if (r.rx.empty())
+    r.rx.resize(RX_BUF_SIZE);
+  for (int i = 0; i < READS_PER_WAKE; ++i)
+  {
+    if (must_pause(r))
+    {
+      if (!r.sources_paused) // later events from the same epoll_wait find it done
+        pause_sources(r);
+      return;
+    }
+    ssize_t n = recv(s.fd, r.rx.data(), r.rx.size(), 0);
+    if (n < 0 && would_block())
+      return;
+    if (n <= 0 || !feed_ctmp(s, r.rx.data(), size_t(n), now_ns(), [&]
+                             { on_frame(r, s); }))
+    {
+      drop_source(r, s); // EOF, error or invalid frame
+      return;
+    }
+    if (size_t(n) < r.rx.size())
+      return; // drained; level-triggered epoll reports anything newer
+  }
+}
+
+// Hand the frames this reactor had no say in ordering to the sequencer.
+static void publish_unordered(Reactor &r)
+{
+  Inbox &in = reactors[0]->inbox;
+  bool idle;
+  {
+    std::lock_guard<std::mutex> lk(in.mu);
+    idle = in.unordered.empty();
+    in.unordered.insert(in.unordered.end(), r.to_sequencer.begin(), r.to_sequencer.end());
+    if (in.unordered.size() >= UNORDERED_MAX)
+      in.full.store(true, std::memory_order_relaxed);
+  }
+  if (idle)
+  {
+    uint64_t one = 1;
+    ssize_t n = write(in.conn.fd, &one, sizeof(one));
+    (void)n;
+  }
+  r.to_sequencer.clear();
+}
+
+static void wake_reactor(Reactor &r)
+{
+  uint64_t one = 1;
+  ssize_t n = write(r.inbox.conn.fd, &one, sizeof(one));
+  (void)n;
+}
+
+static void wake_peers(Reactor &r)
+{
+  for (auto &p : reactors)
+    if (p.get() != &r)
+      wake_reactor(*p);
+}
+
+// Does anybody read r's ring: every peer (for its replay history), or a
+// peer reading or asking to join? A reader left without destinations
+// gives up its cursor in drain_ring, one gaining its first asks to join.
+static bool ring_has_readers(Reactor &r)
+{
+  if (!r.bcast.cursors)
+    return false;
+  if (options.replay_frames > 0)
+    return true;
+  for (unsigned i = 0; i < reactors.size(); ++i)
+  {
+    const RingCursor &c = r.bcast.cursors[i];
+    if (i != r.id && (c.active.load(std::memory_order_acquire) || c.join.load(std::memory_order_acquire)))
+      return true;
+  }
+  return false;
+}
+
+// Queue the first n outbox frames for the journal writer, moving them if
+// take, and wake it if it had caught up. What does not fit is dropped.
+static void journal_offer(Reactor &r, size_t n, bool take)
+{
+  if (!journal || n == 0)
+    return;
+  JournalQueue &q = r.journal_q;
+  const uint64_t head = q.head.load(std::memory_order_relaxed);
+  const bool failed = journal->failed.load(std::memory_order_acquire);
+  const uint64_t tail = failed ? head : q.tail.load(std::memory_order_acquire);
+  for (; q.reclaimed < tail; ++q.reclaimed)
+    q.slot(q.reclaimed).reset();
+
+  const size_t fit = failed ? 0 : std::min(size_t(JOURNAL_SLOTS - (head - q.reclaimed)), n);
+  if (fit < n)
+    bump(r.counters.journal_drops, n - fit);
+  if (fit == 0)
+    return;
+  for (size_t k = 0; k < fit; ++k)
+  {
+    if (take)
+      q.slot(head + k) = std::move(r.outbox[k]);
+    else
+      q.slot(head + k) = r.outbox[k];
+  }
+  q.head.store(head + fit); // seq_cst: pairs with the writer's check in journal_drain
+  if (q.tail.load() == head)
+  {
+    uint64_t one = 1;
+    ssize_t w = write(journal->efd, &one, sizeof(one));
+    (void)w;
+  }
+}
+
+// Mark r's ring full (frames wait in the outbox) or not. Under Global order
+// the other reactors pause with the sequencer, so it wakes them on clearing.
+static void set_stalled(Reactor &r, bool on)
+{
+  if (r.bcast.stalled.load(std::memory_order_relaxed) == on)
+    return;
+  r.bcast.stalled.store(on); // seq_cst: pairs with the reader's check in drain_ring
+  if (!on && options.order == SourceOrder::Global && r.id == 0)
+    wake_peers(r);
+}
+
+// Move this round's frames into r's broadcast ring and the journal queue,
+// and wake the readers that had caught up. Frames that do not fit the ring
+// wait in the outbox, and r stops reading its sources until they are in;
+// the journal never holds them back.
+static void publish(Reactor &r)
+{
+  if (!r.to_sequencer.empty())
+    publish_unordered(r);
+  if (r.outbox.empty())
+    return;
+  if (!ring_has_readers(r))
+  {
+    journal_offer(r, r.outbox.size(), true);
+    r.outbox.clear();
+    set_stalled(r, false);
+    return;
+  }
+
+  BroadcastRing &b = r.bcast;
+  const uint64_t head = b.head.load(std::memory_order_relaxed);
+  uint64_t oldest = head;
+  const unsigned readers = unsigned(reactors.size());
+  for (unsigned i = 0; i < readers; ++i)
+  {
+    RingCursor &c = b.cursors[i];
+    if (i == r.id)
+      continue;
+    if (!c.active.load(std::memory_order_acquire) && c.join.load(std::memory_order_acquire))
+    {
+      c.pos.store(head, std::memory_order_relaxed);
+      c.join.store(false, std::memory_order_relaxed);
+      c.active.store(true, std::memory_order_release);
+    }
+    if (c.active.load(std::memory_order_acquire))
+      oldest = std::min(oldest, c.pos.load(std::memory_order_acquire));
+  }
+  for (; b.reclaimed < oldest; ++b.reclaimed)
+    b.slot(b.reclaimed).reset();
+
+  const size_t n = std::min(size_t(BROADCAST_SLOTS - (head - b.reclaimed)), r.outbox.size());
+  journal_offer(r, n, false);
+  for (size_t k = 0; k < n; ++k)
+    b.slot(head + k) = std::move(r.outbox[k]);
+  b.head.store(head + n); // seq_cst: pairs with the reader's check in drain_ring
+  r.outbox.erase(r.outbox.begin(), r.outbox.begin() + ptrdiff_t(n));
+  set_stalled(r, !r.outbox.empty());
+  if (n == 0)
+    return;
+
+  for (unsigned i = 0; i < readers; ++i)
+  {
+    RingCursor &c = b.cursors[i];
+    if (i != r.id && c.active.load(std::memory_order_acquire) && c.pos.load() == head)
+      wake_reactor(*reactors[i]);
+  }
+}
+
+// At the end of a round, pause or resume r's sources to match must_pause().
+static void apply_backpressure(Reactor &r)
+{
+  const bool pause = must_pause(r);
+  if (pause && !r.sources_paused)
+    pause_sources(r);
+  else if (!pause && r.sources_paused)
+    resume_sources(r);
+}
+
+// Broadcast everything new in peer p's ring to r's destinations. A reader
+// left without destinations stops holding p's frames back.
+static void drain_ring(Reactor &r, Reactor &p)
+{
+  BroadcastRing &b = p.bcast;
+  RingCursor &c = b.cursors[r.id];
+  if (!c.active.load(std::memory_order_acquire))
+    return;
+
+  uint64_t pos = c.pos.load(std::memory_order_relaxed);
+  for (uint64_t head; (head = b.head.load()) != pos;)
+  {
+    c.max_lag = std::max(c.max_lag, head - pos);
+    for (; pos != head; ++pos)
+      broadcast(r, b.slot(pos));
+    c.pos.store(pos); // seq_cst, then re-read head: publish() skips waking us if we lag
+  }
+  if (b.stalled.load())
+    wake_reactor(p);
+  if (r.nsinks == 0 && options.replay_frames == 0) // with replay, history needs every frame
+    c.active.store(false, std::memory_order_release);
+}
+
+// r just got its first destination: ask every peer to include it.
+static void join_rings(Reactor &r)
+{
+  for (auto &p : reactors)
+  {
+    RingCursor &c = p->bcast.cursors[r.id];
+    if (p.get() != &r && !c.active.load(std::memory_order_acquire))
+      c.join.store(true, std::memory_order_release);
+  }
+}
+
+static std::string peer_name(int fd)
+{
+  sockaddr_in a{};
+  socklen_t len = sizeof(a);
+  char ip[INET_ADDRSTRLEN] = "?";
+  if (getpeername(fd, reinterpret_cast<sockaddr *>(&a), &len) == 0)
+    inet_ntop(AF_INET, &a.sin_addr, ip, sizeof(ip));
+  return std::string(ip) + ':' + std::to_string(ntohs(a.sin_port));
+}
+
+// Print r's latency histograms (run on r's thread, which owns
+// parse_stats): parsing, checksums, every destination, and all of them
+// together including those that have left.
+static void dump_latency(Reactor &r)
+{
+  Histogram all;
+  all.merge(r.departed);
+  std::string sinks;
+  auto add = [&](const std::vector<std::unique_ptr<Sink>> &list)
+  {
+    for (auto &d : list)
+    {
+      all.merge(d->latency);
+      sinks += latency_line("sink " + peer_name(d->fd), d->latency);
+    }
+  };
+  for (auto &subs : r.sinks)
+    add(subs);
+  for (auto &fx : r.filters)
+    add(fx.sinks);
+
+  std::string out = "[*] reactor " + std::to_string(r.id) +
+                    " latency, ns:                count       p50       p90       p99     p99.9       max\n";
+  out += latency_line("parse (sampled)", parse_stats.parse);
+  out += latency_line("checksum (sampled)", parse_stats.checksum);
+  out += latency_line("ingress to written", all);
+  out += sinks;
+  std::lock_guard<std::mutex> lk(dump_mu);
+  std::cerr << out << std::flush;
+}
+
+// Answer scrape gen with what only r's thread can read: its destinations,
+// its sources and its thread's parse stats.
+static void post_scrape(Reactor &r, unsigned gen)
+{
+  Histogram all;
+  all.merge(r.departed);
+  std::vector<SinkSample> sinks;
+  auto add = [&](const std::vector<std::unique_ptr<Sink>> &list)
+  {
+    for (auto &d : list)
+    {
+      all.merge(d->latency);
+      SinkSample x{peer_name(d->fd), d->channel, d->queue.size(), d->queue.bytes(),
+                   d->dropped, d->latency.count(), {}};
+      for (unsigned i = 0; i < 4; ++i)
+        x.latency[i] = d->latency.quantile(SCRAPE_QUANTILES[i]);
+      sinks.push_back(std::move(x));
+    }
+  };
+  for (auto &subs : r.sinks)
+    add(subs);
+  for (auto &fx : r.filters)
+    add(fx.sinks);
+  add(r.joining);
+
+  {
+    std::lock_guard<std::mutex> lk(scrape_mu);
+    ScrapePart &p = r.scrape;
+    p.gen = gen;
+    p.sinks.swap(sinks);
+    p.sources = r.sources.size();
+    p.latency.clear();
+    p.latency.merge(all);
+    p.parse.clear();
+    p.parse.merge(parse_stats.parse);
+    p.checksum.clear();
+    p.checksum.merge(parse_stats.checksum);
+  }
+  scrape_cv.notify_all();
+}
+
+static void on_inbox(Reactor &r)
+{
+  uint64_t count;
+  ssize_t n = read(r.inbox.conn.fd, &count, sizeof(count));
+  (void)n;
+
+  const unsigned dumps = dump_requests.load();
+  if (r.dumped != dumps)
+  {
+    r.dumped = dumps;
+    dump_latency(r);
+  }
+  const unsigned scrapes = scrape_requests.load();
+  if (r.scraped != scrapes)
+  {
+    r.scraped = scrapes;
+    post_scrape(r, scrapes);
+  }
+
+  for (auto &p : reactors)
+    if (p.get() != &r)
+      drain_ring(r, *p);
+
+  std::vector<FrameRef> unordered;
+  bool was_full;
+  {
+    std::lock_guard<std::mutex> lk(r.inbox.mu);
+    unordered.swap(r.inbox.unordered);
+    was_full = r.inbox.full.exchange(false, std::memory_order_relaxed);
+  }
+  if (was_full)
+    wake_peers(r); // they paused for us
+  for (FrameRef &m : unordered)
+    deliver(r, std::move(m)); // sequencer: this is where their order is fixed
+}
+
+static bool parse_hex(const char *p, size_t n, std::string &out)
+{
+  if (n % 2 != 0)
+    return false;
+  for (size_t i = 0; i < n; i += 2)
+  {
+    char pair[3] = {p[i], p[i + 1], 0};
+    char *end;
+    const unsigned long v = std::strtoul(pair, &end, 16);
+    if (end != pair + 2)
+      return false;
+    out.push_back(char(v));
+  }
+  return true;
+}
+
+// Parse a subscription body: space-separated "prefix=HEX" (any number,
+// matched against the start of the body) and "len=MIN-MAX" or "len=N"
+// (the LENGTH field), plus for late joiners "last=N" or "since=SEQ". An
+// empty body subscribes to every frame.
+static bool parse_subscription(const uint8_t *p, size_t n, Filter &f, Replay &from)
+{
+  const std::string text(reinterpret_cast<const char *>(p), n);
+  size_t i = 0;
+  while ((i = text.find_first_not_of(" \t\r\n", i)) != std::string::npos)
+  {
+    const size_t end = std::min(text.find_first_of(" \t\r\n", i), text.size());
+    const std::string term = text.substr(i, end - i);
+    i = end;
+    if (term.compare(0, 7, "prefix=") == 0)
+    {
+      std::string prefix;
+      if (!parse_hex(term.data() + 7, term.size() - 7, prefix))
+        return false;
+      f.prefixes.push_back(prefix);
+    }
+    else if (term.compare(0, 4, "len=") == 0)
+    {
+      unsigned lo, hi;
+      char dash;
+      const int k = std::sscanf(term.c_str() + 4, "%u%c%u", &lo, &dash, &hi);
+      if (k == 1)
+        hi = lo;
+      else if (k != 3 || dash != '-')
+        return false;
+      if (lo > hi || hi > unsigned(MAX_BODY))
+        return false;
+      f.min_len = uint16_t(lo);
+      f.max_len = uint16_t(hi);
+    }
+    else if (term.compare(0, 5, "last=") == 0 || term.compare(0, 6, "since=") == 0)
+    {
+      const size_t eq = term.find('=');
+      char *end;
+      from.kind = eq == 4 ? Replay::Last : Replay::Since;
+      from.n = std::strtoull(term.c_str() + eq + 1, &end, 10);
+      if (eq + 1 == term.size() || *end != '\0')
+        return false;
+    }
+    else
+      return false;
+  }
+
+  // An empty prefix matches everything; one that extends another is
+  // redundant, and would match a frame twice.
+  if (std::find(f.prefixes.begin(), f.prefixes.end(), std::string()) != f.prefixes.end())
+    f.prefixes.clear();
+  std::sort(f.prefixes.begin(), f.prefixes.end());
+  size_t kept = 0;
+  for (size_t j = 0; j < f.prefixes.size(); ++j)
+    if (kept == 0 || f.prefixes[j].compare(0, f.prefixes[kept - 1].size(), f.prefixes[kept - 1]) != 0)
+      f.prefixes[kept++] = f.prefixes[j];
+  f.prefixes.resize(kept);
+  return true;
+}
+
+// Take n bytes a destination sent. Each complete CTMP frame in them is a
+// subscription and replaces its filter. Only a late joiner's first one may
+// ask for a replay, and since=SEQ needs frames numbered in one total order.
+// False on an invalid frame.
+static bool on_subscription(Reactor &r, Sink &d, const uint8_t *p, size_t n)
+{
+  d.ctl.insert(d.ctl.end(), p, p + n);
+  size_t off = 0;
+  for (uint16_t len; d.ctl.size() - off >= size_t(HEADER_LEN); off += HEADER_LEN + len)
+  {
+    if (check_header(d.ctl.data() + off, len) != CtmpError::None)
+      return false;
+    if (d.ctl.size() - off < size_t(HEADER_LEN) + len)
+      break;
+    Filter f;
+    Replay from;
+    if (!parse_subscription(d.ctl.data() + off + HEADER_LEN, len, f, from))
+      return false;
+    if (from.kind != Replay::None && !d.joining)
+      return false;
+    if (from.kind == Replay::Since && options.order != SourceOrder::Global && reactors.size() > 1)
+      return false;
+    subscribe(r, d, std::move(f));
+    if (from.kind != Replay::None && !replay(r, d, from))
+      return false;
+  }
+  d.ctl.erase(d.ctl.begin(), d.ctl.begin() + off);
+  return true;
+}
+
+static void on_sink(Reactor &r, Sink &d, uint32_t events)
+{
+  if ((events & EPOLLERR) && !reap_errqueue(d))
+  {
+    drop_sink(r, d);
+    return;
+  }
+  if (events & (EPOLLRDHUP | EPOLLHUP))
+  {
+    drop_sink(r, d);
+    return;
+  }
+  if (events & EPOLLIN)
+  {
+    // Destinations only ever send subscription frames.
+    uint8_t buf[4096];
+    ssize_t n;
+    while ((n = recv(d.fd, buf, sizeof(buf), 0)) > 0)
+    {
+      if (!on_subscription(r, d, buf, size_t(n)))
+      {
+        std::cerr << "[!] closing destination: bad subscription frame\n";
+        drop_sink(r, d);
+        return;
+      }
+    }
+    if (n == 0 || !would_block())
+    {
+      drop_sink(r, d);
+      return;
+    }
+  }
+  if ((events & EPOLLOUT) && !flush_sink(r, d))
+    drop_sink(r, d);
+}
 
-std::vector<int> sinks;
-std::mutex sinks_mu;
+static void uring_recv(Reactor &r, Source &s)
+{
+  io_uring_sqe *sqe = uring_sqe(*r.ring);
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = s.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = reinterpret_cast<uint64_t>(static_cast<Conn *>(&s));
+  ++s.inflight;
+}
 
-static void handle_signal(int)
+static void on_accept(Reactor &r, Conn &listener)
 {
-  running.store(false);
-  if (src_listener >= 0)
+  for (;;)
+  {
+    int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return; // EAGAIN, or a transient error such as ECONNABORTED
+
+    const Listener &l = static_cast<Listener &>(listener);
+    if (l.kind == Kind::SrcListener)
+    {
+      r.sources.push_back(std::make_unique<Source>(fd, l.channel));
+      Source &s = *r.sources.back();
+      if (!r.ring)
+        watch(r, s, r.sources_paused ? 0u : uint32_t(EPOLLIN));
+      else if (!r.sources_paused) // else armed by resume_sources
+        uring_recv(r, s);
+    }
+    else
+    {
+      auto d = std::make_unique<Sink>(fd, l.channel, l.policy);
+      d->joining = l.replay;
+      if (options.zerocopy_min > 0 && !r.ring)
+      {
+        int one = 1;
+        d->zc = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+      }
+      watch(r, *d, EPOLLIN | EPOLLRDHUP);
+      list_sink(r, std::move(d));
+      if (++r.nsinks == 1 && reactors.size() > 1)
+        join_rings(r);
+    }
+  }
+}
+
+// Handle whatever epfd has ready; returns the number of events seen.
+static int epoll_round(Reactor &r, int timeout)
+{
+  epoll_event events[MAX_EVENTS];
+  int n = epoll_wait(r.epfd, events, MAX_EVENTS, timeout);
+  if (n < 0)
   {
-    close(src_listener);
-    src_listener = -1;
+    if (errno != EINTR)
+    {
+      perror("epoll_wait");
+      running.store(false);
+    }
+    return 0;
   }
-  if (dst_listener >= 0)
+
+  for (int i = 0; i < n; ++i)
   {
-    close(dst_listener);
-    dst_listener = -1;
+    Conn &c = *static_cast<Conn *>(events[i].data.ptr);
+    if (c.fd < 0)
+      continue; // closed earlier in this round
+
+    switch (c.kind)
+    {
+    case Kind::Wake:
+    case Kind::Poller:
+    case Kind::Cancel:
+      break;
+    case Kind::Inbox:
+      on_inbox(r);
+      break;
+    case Kind::SrcListener:
+    case Kind::DstListener:
+      on_accept(r, c);
+      break;
+    case Kind::Source:
+      on_source(r, static_cast<Source &>(c));
+      break;
+    case Kind::Sink:
+      on_sink(r, static_cast<Sink &>(c), events[i].events);
+      break;
+    }
   }
+  return n;
 }
 
-// 16-bit one's-complement checksum of a byte buffer
-static uint16_t compute_checksum(const std::vector<uint8_t> &b)
+static void on_recv_cqe(Reactor &r, Source &s, const io_uring_cqe &cqe)
 {
-  uint32_t sum = 0;
-  const size_t n = b.size();
+  Uring &u = *r.ring;
+  const bool more = cqe.flags & IORING_CQE_F_MORE;
+  const unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  if (!more)
+    --s.inflight;
+  if (s.fd < 0)
+  {
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+      uring_recycle(u, bid);
+    return;
+  }
 
-  for (size_t i = 0; i + 1 < n; i += 2)
+  if (cqe.res > 0)
   {
-    sum += (uint16_t(b[i]) << 8) | b[i + 1];
-    if (sum > 0xFFFF)
-      sum = (sum & 0xFFFF) + 1; // fold
+    const bool ok = feed_ctmp(s, u.bufs + size_t(bid) * RECV_BUF_SIZE, size_t(cqe.res), now_ns(),
+                              [&]
+                              { on_frame(r, s); });
+    uring_recycle(u, bid);
+    if (!ok)
+    {
+      drop_source(r, s);
+      return;
+    }
+    if (!r.sources_paused && must_pause(r))
+      pause_sources(r);
   }
-  if (n & 1)
+  else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
   {
-    sum += uint16_t(b[n - 1]) << 8;
-    if (sum > 0xFFFF)
-      sum = (sum & 0xFFFF) + 1;
+    drop_source(r, s); // EOF or error
+    return;
   }
-  return uint16_t(~sum) & 0xFFFF;
+
+  if (!more && !r.sources_paused)
+    uring_recv(r, s); // re-arm after ENOBUFS, a cancel or a terminated multishot
 }
 
-// Read and validate a CTMP message from sock into out
-static bool read_ctmp(int sock, std::vector<uint8_t> &out)
+static void on_send_cqe(Reactor &r, Sink &d, const io_uring_cqe &cqe)
 {
-  uint8_t hdr[HEADER_LEN];
-  if (recv(sock, hdr, HEADER_LEN, MSG_WAITALL) != HEADER_LEN)
-    return false;
+  --d.inflight;
+  d.busy = false;
+  d.sending = 0;
+  if (d.fd < 0)
+    return;
 
-  if (hdr[0] != MAGIC)
-    return false;
+  if (cqe.res < 0 && cqe.res != -EAGAIN && cqe.res != -EINTR)
+  {
+    drop_sink(r, d);
+    return;
+  }
+  if (cqe.res > 0)
+    sink_advance(r, d, size_t(cqe.res));
+  flush_sink(r, d);
+}
+
+static void arm_poller(Reactor &r)
+{
+  io_uring_sqe *sqe = uring_sqe(*r.ring);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = r.epfd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = reinterpret_cast<uint64_t>(&r.poller);
+}
+
+// One io_uring_enter per round both submits every queued recv/send and
+// waits for the next completion.
+static void uring_loop(Reactor &r)
+{
+  Uring &u = *r.ring;
+  arm_poller(r);
+  while (running.load())
+  {
+    uring_enter(u, true);
+
+    unsigned head = *u.cq_head;
+    const unsigned tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+    {
+      const io_uring_cqe cqe = u.cqes[head & *u.cq_mask];
+      Conn &c = *reinterpret_cast<Conn *>(cqe.user_data);
+      switch (c.kind)
+      {
+      case Kind::Poller:
+        while (epoll_round(r, 0) == MAX_EVENTS)
+        {
+        }
+        arm_poller(r);
+        break;
+      case Kind::Source:
+        on_recv_cqe(r, static_cast<Source &>(c), cqe);
+        break;
+      case Kind::Sink:
+        on_send_cqe(r, static_cast<Sink &>(c), cqe);
+        break;
+      default:
+        break;
+      }
+    }
+    __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+
+    flush_pending(r);
+    publish(r);
+    apply_backpressure(r);
+    r.dead.erase(std::remove_if(r.dead.begin(), r.dead.end(),
+                                [](const std::unique_ptr<Conn> &c)
+                                { return c->inflight == 0; }),
+                 r.dead.end());
+  }
+}
 
-  const uint8_t options = hdr[1];
-  const uint16_t len = ntohs(*reinterpret_cast<uint16_t *>(hdr + 2));
-  const uint16_t net_ck = ntohs(*reinterpret_cast<uint16_t *>(hdr + 4));
+static std::string journal_path(uint64_t segment, const char *ext)
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), "/journal-%010llu%s", static_cast<unsigned long long>(segment), ext);
+  return options.journal_dir + std::string(name);
+}
 
-  if (len > MAX_BODY)
+// Create and map segment j.segment, both files at their full size.
+static bool journal_open(Journal &j)
+{
+  j.idx_cap = options.journal_segment / 64; // rolls on the index first below 64-byte frames
+  const size_t idx_bytes = j.idx_cap * sizeof(JournalEntry);
+  j.data_fd = open(journal_path(j.segment, ".ctmp").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  j.idx_fd = open(journal_path(j.segment, ".idx").c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (j.data_fd < 0 || j.idx_fd < 0)
+    return false;
+  j.on_disk.push_back(j.segment);
+  if ((errno = posix_fallocate(j.data_fd, 0, off_t(options.journal_segment))) != 0 ||
+      (errno = posix_fallocate(j.idx_fd, 0, off_t(idx_bytes))) != 0)
     return false;
-  if (hdr[6] != 0 || hdr[7] != 0)
-    return false; // padding must be zero
 
-  out.resize(HEADER_LEN + len);
-  std::memcpy(out.data(), hdr, HEADER_LEN);
-  if (recv(sock, out.data() + HEADER_LEN, len, MSG_WAITALL) != len)
+  void *d = mmap(nullptr, options.journal_segment, PROT_READ | PROT_WRITE, MAP_SHARED, j.data_fd, 0);
+  void *x = mmap(nullptr, idx_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, j.idx_fd, 0);
+  if (d == MAP_FAILED || x == MAP_FAILED)
     return false;
+  madvise(d, options.journal_segment, MADV_SEQUENTIAL);
+  j.data = static_cast<uint8_t *>(d);
+  j.idx = static_cast<JournalEntry *>(x);
+  j.data_used = j.idx_used = j.data_synced = j.idx_synced = 0;
+  return true;
+}
 
-  // If sensitive (bit 1 -> 0x40), verify checksum
-  if (options & 0x40)
+// Write what was appended since the last sync through to the files.
+static void journal_sync(Journal &j)
+{
+  const size_t page = size_t(sysconf(_SC_PAGESIZE));
+  auto sync = [page](void *base, size_t from, size_t to)
   {
-    std::vector<uint8_t> tmp = out;
-    tmp[4] = 0xCC; // per spec: set checksum field to 0xCC bytes when computing
-    tmp[5] = 0xCC;
-    const uint16_t calc = compute_checksum(tmp);
-    if (calc != net_ck)
-    {
-      std::cerr << "[!] dropping packet: checksum mismatch\n";
-      return false;
-    }
+    from &= ~(page - 1);
+    if (to > from)
+      msync(static_cast<uint8_t *>(base) + from, to - from, MS_SYNC);
+  };
+  sync(j.data, j.data_synced, j.data_used);
+  sync(j.idx, j.idx_synced * sizeof(JournalEntry), j.idx_used * sizeof(JournalEntry));
+  j.data_synced = j.data_used;
+  j.idx_synced = j.idx_used;
+}
+
+// Sync and unmap the open segment, trimming both files to what was used.
+static void journal_close(Journal &j)
+{
+  if (j.data && j.idx)
+    journal_sync(j);
+  if (j.data)
+    munmap(j.data, options.journal_segment);
+  if (j.idx)
+    munmap(j.idx, j.idx_cap * sizeof(JournalEntry));
+  if (j.data_fd >= 0 && ftruncate(j.data_fd, off_t(j.data_used)) < 0)
+    perror("journal");
+  if (j.idx_fd >= 0 && ftruncate(j.idx_fd, off_t(j.idx_used * sizeof(JournalEntry))) < 0)
+    perror("journal");
+  close(j.data_fd);
+  close(j.idx_fd);
+  j.data = nullptr;
+  j.idx = nullptr;
+  j.data_fd = j.idx_fd = -1;
+}
+
+// Delete the oldest segments beyond options.journal_keep and open j.segment.
+static bool journal_start(Journal &j)
+{
+  while (options.journal_keep > 0 && j.on_disk.size() >= options.journal_keep)
+  {
+    unlink(journal_path(j.on_disk.front(), ".ctmp").c_str());
+    unlink(journal_path(j.on_disk.front(), ".idx").c_str());
+    j.on_disk.erase(j.on_disk.begin());
   }
+  return journal_open(j);
+}
+
+static bool journal_roll(Journal &j)
+{
+  journal_close(j);
+  ++j.segment;
+  return journal_start(j);
+}
+
+static bool journal_append(Journal &j, const Frame &m, uint64_t now_ns)
+{
+  if ((j.data_used + m.size() > options.journal_segment || j.idx_used == j.idx_cap) && !journal_roll(j))
+    return false;
+  std::memcpy(j.data + j.data_used, m.data(), m.size());
+  j.idx[j.idx_used++] = JournalEntry{j.data_used, m.seq, now_ns, m.channel, m.len};
+  j.data_used += m.size();
+  ++j.frames;
+  j.bytes += m.size();
   return true;
 }
 
-static void source_loop(int fd)
+// Append everything new in p's journal queue, like drain_ring does for a
+// broadcast ring.
+static bool journal_drain(Journal &j, Reactor &p, uint64_t now_ns)
 {
-  std::vector<uint8_t> msg;
-  while (running.load())
+  JournalQueue &q = p.journal_q;
+  uint64_t pos = q.tail.load(std::memory_order_relaxed);
+  for (uint64_t head; (head = q.head.load()) != pos;)
   {
-    if (!read_ctmp(fd, msg))
-      break;
+    q.max_lag = std::max(q.max_lag, head - pos);
+    for (; pos != head; ++pos)
+      if (!journal_append(j, *q.slot(pos), now_ns))
+        return false;
+    q.tail.store(pos); // seq_cst, then re-read head: journal_offer() skips waking us if we lag
+  }
+  return true;
+}
 
-    std::lock_guard<std::mutex> lk(sinks_mu);
-    for (auto it = sinks.begin(); it != sinks.end();)
+// The journal writer thread: drain every queue when woken, sync once a
+// second. On a write error it stops, and the reactors stop queueing.
+static void run_journal(Journal &j)
+{
+  uint64_t last_sync = 0;
+  bool ok = true;
+  for (bool last = false; ok && !last;)
+  {
+    last = j.stop.load();
+    if (!last)
     {
-      int d = *it;
-      ssize_t n = send(d, msg.data(), msg.size(), MSG_NOSIGNAL);
-      if (n != static_cast<ssize_t>(msg.size()))
+      pollfd pfd{j.efd, POLLIN, 0};
+      if (poll(&pfd, 1, 1000) > 0)
       {
-        close(d);
-        it = sinks.erase(it);
-      }
-      else
-      {
-        ++it;
+        uint64_t count;
+        ssize_t n = read(j.efd, &count, sizeof(count));
+        (void)n;
       }
     }
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const uint64_t now = uint64_t(ts.tv_sec) * 1000000000u + uint64_t(ts.tv_nsec);
+    for (size_t i = 0; i < reactors.size() && ok; ++i)
+      ok = journal_drain(j, *reactors[i], now);
+    for (size_t i = 0; i < reactors.size() && ok && last; ++i)
+      for (const FrameRef &m : reactors[i]->outbox) // the reactors are done: left over from a full ring
+        ok = ok && journal_append(j, *m, now);
+    if (ok && (last || now - last_sync >= 1000000000u))
+    {
+      journal_sync(j);
+      last_sync = now;
+    }
+  }
+  if (!ok)
+  {
+    perror("[!] journal stopped");
+    j.failed.store(true, std::memory_order_release);
+  }
+  journal_close(j);
+}
+
+// Create the journal directory if needed, pick up the segments already in
+// it (retention counts them) and open the next one.
+static void setup_journal()
+{
+  journal = std::make_unique<Journal>();
+  Journal &j = *journal;
+  if (mkdir(options.journal_dir, 0755) < 0 && errno != EEXIST)
+  {
+    perror("journal");
+    std::exit(1);
+  }
+  if (DIR *dir = opendir(options.journal_dir))
+  {
+    while (dirent *e = readdir(dir))
+    {
+      unsigned long long n;
+      char ext[8];
+      if (std::sscanf(e->d_name, "journal-%llu.%7s", &n, ext) == 2 && std::strcmp(ext, "ctmp") == 0)
+        j.on_disk.push_back(n);
+    }
+    closedir(dir);
+  }
+  std::sort(j.on_disk.begin(), j.on_disk.end());
+  j.segment = j.on_disk.empty() ? 0 : j.on_disk.back() + 1;
+  j.efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (j.efd < 0 || !journal_start(j))
+  {
+    perror("journal");
+    std::exit(1);
+  }
+}
+
+static void run_reactor(Reactor &r)
+{
+  pool_cache.hits = &r.counters.pool_hits;
+  pool_cache.misses = &r.counters.pool_misses;
+  r.wake.fd = wake_fd;
+  watch(r, r.wake, EPOLLIN);
+  watch(r, r.inbox.conn, EPOLLIN);
+  for (auto &l : r.src_accept)
+    watch(r, *l, EPOLLIN);
+  for (auto &l : r.dst_accept)
+    watch(r, *l, EPOLLIN);
+  for (auto &l : r.rpl_accept)
+    watch(r, *l, EPOLLIN);
+
+  if (r.ring)
+  {
+    r.poller.fd = r.epfd;
+    uring_loop(r);
+  }
+  else
+  {
+    while (running.load())
+    {
+      epoll_round(r, -1);
+      flush_pending(r);
+      publish(r);
+      apply_backpressure(r);
+      r.dead.clear();
+    }
+  }
+
+  for (auto &s : r.sources)
+    close(s->fd);
+  for (auto &subs : r.sinks)
+    for (auto &d : subs)
+      close(d->fd);
+  for (auto &fx : r.filters)
+    for (auto &d : fx.sinks)
+      close(d->fd);
+  for (auto &d : r.joining)
+    close(d->fd);
+  for (auto &l : r.src_accept)
+    close(l->fd);
+  for (auto &l : r.dst_accept)
+    close(l->fd);
+  for (auto &l : r.rpl_accept)
+    close(l->fd);
+  close(r.inbox.conn.fd);
+  if (r.ring)
+    close(r.ring->fd);
+  close(r.epfd);
+  pool_flush();
+}
+
+// "# HELP" and "# TYPE" lines opening a metric family.
+static void metric_family(std::string &out, const char *name, const char *type, const char *help)
+{
+  out += std::string("# HELP ") + name + ' ' + help + "\n# TYPE " + name + ' ' + type + '\n';
+}
+
+static void sample(std::string &out, const std::string &name, const std::string &labels, uint64_t v)
+{
+  out += name;
+  if (!labels.empty())
+    out += '{' + labels + '}';
+  out += ' ' + std::to_string(v) + '\n';
+}
+
+// Latency quantiles (ns in, seconds out) and count, as a summary.
+static void summary(std::string &out, const std::string &name, const std::string &labels,
+                    const uint64_t (&ns)[4], uint64_t count)
+{
+  for (unsigned i = 0; i < 4; ++i)
+  {
+    char line[96];
+    std::snprintf(line, sizeof(line), "quantile=\"%g\"} %.9g\n", SCRAPE_QUANTILES[i], double(ns[i]) / 1e9);
+    out += name + '{' + labels + (labels.empty() ? "" : ",") + line;
+  }
+  sample(out, name + "_count", labels, count);
+}
+
+static void summary(std::string &out, const std::string &name, const Histogram &h)
+{
+  uint64_t ns[4];
+  for (unsigned i = 0; i < 4; ++i)
+    ns[i] = h.quantile(SCRAPE_QUANTILES[i]);
+  summary(out, name, "", ns, h.count());
+}
+
+// The metrics page. Counters are summed straight from every reactor; the
+// rest is asked of each reactor through its inbox and waited for (a second
+// at most, else its previous answer is used).
+static std::string render_metrics()
+{
+  const unsigned gen = scrape_requests.fetch_add(1) + 1;
+  for (auto &r : reactors)
+  {
+    uint64_t one = 1;
+    ssize_t n = write(r->inbox.conn.fd, &one, sizeof(one));
+    (void)n;
+  }
+
+  std::vector<std::vector<SinkSample>> sinks(reactors.size());
+  size_t sources = 0;
+  Histogram latency, parse, checksum;
+  {
+    std::unique_lock<std::mutex> lk(scrape_mu);
+    scrape_cv.wait_for(lk, std::chrono::seconds(1), [&]
+                       { return std::all_of(reactors.begin(), reactors.end(),
+                                            [&](const std::unique_ptr<Reactor> &r)
+                                            { return r->scrape.gen == gen; }); });
+    for (size_t i = 0; i < reactors.size(); ++i)
+    {
+      const ScrapePart &p = reactors[i]->scrape;
+      sinks[i] = p.sinks;
+      sources += p.sources;
+      latency.merge(p.latency);
+      parse.merge(p.parse);
+      checksum.merge(p.checksum);
+    }
+  }
+  size_t nsinks = 0;
+  for (const auto &list : sinks)
+    nsinks += list.size();
+  auto total = [&](std::atomic<uint64_t> Counters::*c)
+  {
+    uint64_t n = 0;
+    for (auto &r : reactors)
+      n += (r->counters.*c).load(std::memory_order_relaxed);
+    return n;
+  };
+
+  std::string out;
+  metric_family(out, "ctmp_frames_in_total", "counter", "Valid frames read from sources.");
+  sample(out, "ctmp_frames_in_total", "", total(&Counters::frames_in));
+  metric_family(out, "ctmp_bytes_in_total", "counter", "Bytes of valid frames read from sources.");
+  sample(out, "ctmp_bytes_in_total", "", total(&Counters::bytes_in));
+  metric_family(out, "ctmp_frames_out_total", "counter", "Frames fully written to destinations, once per destination.");
+  sample(out, "ctmp_frames_out_total", "", total(&Counters::frames_out));
+  metric_family(out, "ctmp_bytes_out_total", "counter", "Bytes of frames fully written to destinations.");
+  sample(out, "ctmp_bytes_out_total", "", total(&Counters::bytes_out));
+
+  metric_family(out, "ctmp_rejected_frames_total", "counter", "Invalid frames, each closing its source, by reason.");
+  for (unsigned e = 1; e < CTMP_ERRORS; ++e)
+  {
+    uint64_t n = 0;
+    for (auto &r : reactors)
+      n += r->counters.rejected[e].load(std::memory_order_relaxed);
+    sample(out, "ctmp_rejected_frames_total", std::string("reason=\"") + ctmp_error_names[e] + '"', n);
+  }
+  metric_family(out, "ctmp_queue_dropped_frames_total", "counter", "Frames discarded by the drop-oldest and drop-newest policies.");
+  sample(out, "ctmp_queue_dropped_frames_total", "", total(&Counters::queue_drops));
+  metric_family(out, "ctmp_slow_disconnects_total", "counter", "Destinations closed by the disconnect policy.");
+  sample(out, "ctmp_slow_disconnects_total", "", total(&Counters::slow_disconnects));
+
+  metric_family(out, "ctmp_sources", "gauge", "Connected sources.");
+  sample(out, "ctmp_sources", "", sources);
+  metric_family(out, "ctmp_sinks", "gauge", "Connected destinations.");
+  sample(out, "ctmp_sinks", "", nsinks);
+
+  auto sink_labels = [&](size_t r, const SinkSample &x)
+  {
+    return "reactor=\"" + std::to_string(r) + "\",channel=\"" + std::to_string(x.channel) +
+           "\",sink=\"" + x.peer + '"';
+  };
+  metric_family(out, "ctmp_sink_queue_frames", "gauge", "Frames queued for a destination.");
+  for (size_t r = 0; r < sinks.size(); ++r)
+    for (const SinkSample &x : sinks[r])
+      sample(out, "ctmp_sink_queue_frames", sink_labels(r, x), x.queue_frames);
+  metric_family(out, "ctmp_sink_queue_bytes", "gauge", "Bytes queued for a destination.");
+  for (size_t r = 0; r < sinks.size(); ++r)
+    for (const SinkSample &x : sinks[r])
+      sample(out, "ctmp_sink_queue_bytes", sink_labels(r, x), x.queue_bytes);
+  metric_family(out, "ctmp_sink_dropped_frames_total", "counter", "Frames a destination's policy discarded.");
+  for (size_t r = 0; r < sinks.size(); ++r)
+    for (const SinkSample &x : sinks[r])
+      sample(out, "ctmp_sink_dropped_frames_total", sink_labels(r, x), x.dropped);
+  metric_family(out, "ctmp_sink_latency_seconds", "summary", "Source ingress to fully written, per destination.");
+  for (size_t r = 0; r < sinks.size(); ++r)
+    for (const SinkSample &x : sinks[r])
+      summary(out, "ctmp_sink_latency_seconds", sink_labels(r, x), x.latency, x.written);
+
+  metric_family(out, "ctmp_latency_seconds", "summary", "Source ingress to fully written, all destinations.");
+  summary(out, "ctmp_latency_seconds", latency);
+  metric_family(out, "ctmp_parse_seconds", "summary", "Header check, allocation and copy of a frame (sampled).");
+  summary(out, "ctmp_parse_seconds", parse);
+  metric_family(out, "ctmp_checksum_seconds", "summary", "Checksum verification of a sensitive frame (sampled).");
+  summary(out, "ctmp_checksum_seconds", checksum);
+
+  metric_family(out, "ctmp_broadcast_lag_frames", "gauge", "Frames a reader is behind in a reactor's broadcast ring.");
+  for (auto &p : reactors)
+  {
+    if (!p->bcast.cursors)
+      continue;
+    const uint64_t head = p->bcast.head.load(std::memory_order_relaxed);
+    auto lag = [&](unsigned i, const std::string &reader)
+    {
+      const RingCursor &c = p->bcast.cursors[i];
+      if (c.active.load(std::memory_order_relaxed))
+        sample(out, "ctmp_broadcast_lag_frames",
+               "reactor=\"" + std::to_string(p->id) + "\",reader=\"" + reader + '"',
+               head - std::min(head, c.pos.load(std::memory_order_relaxed)));
+    };
+    for (auto &c : reactors)
+      if (c != p)
+        lag(c->id, std::to_string(c->id));
+  }
+  if (journal)
+  {
+    metric_family(out, "ctmp_journal_lag_frames", "gauge", "Frames a reactor has queued for the journal writer.");
+    for (auto &p : reactors)
+    {
+      const uint64_t tail = p->journal_q.tail.load(std::memory_order_relaxed); // first: it chases head
+      const uint64_t head = p->journal_q.head.load(std::memory_order_relaxed);
+      sample(out, "ctmp_journal_lag_frames", "reactor=\"" + std::to_string(p->id) + '"', head - std::min(head, tail));
+    }
+    metric_family(out, "ctmp_journal_dropped_frames_total", "counter", "Frames left out of the journal: its queue was full or it had stopped.");
+    sample(out, "ctmp_journal_dropped_frames_total", "", total(&Counters::journal_drops));
   }
-  close(fd);
+
+  metric_family(out, "ctmp_frame_pool_hits_total", "counter", "Frame buffers served from a free list.");
+  sample(out, "ctmp_frame_pool_hits_total", "", total(&Counters::pool_hits));
+  metric_family(out, "ctmp_frame_pool_misses_total", "counter", "Frame buffers allocated with operator new.");
+  sample(out, "ctmp_frame_pool_misses_total", "", total(&Counters::pool_misses));
+  return out;
 }
 
-static void sink_loop(int fd)
+// Answer one HTTP request on fd: GET /metrics, anything else is a 404.
+static void serve_admin(int fd)
 {
+  timeval tv{1, 0}; // a client that stalls cannot hold up the next one for long
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  char req[2048];
+  size_t have = 0;
+  while (have < sizeof(req) - 1)
   {
-    std::lock_guard<std::mutex> lk(sinks_mu);
-    sinks.push_back(fd);
+    const ssize_t n = recv(fd, req + have, sizeof(req) - 1 - have, 0);
+    if (n <= 0)
+      return;
+    have += size_t(n);
+    req[have] = 0;
+    if (std::strstr(req, "\r\n\r\n") || std::strstr(req, "\n\n"))
+      break;
   }
 
-  // Stay connected until peer closes.
-  char peek;
-  while (running.load() &&
-         recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT) != 0)
+  const char *path = "GET /metrics";
+  const size_t plen = std::strlen(path);
+  std::string body, head;
+  if (have > plen && std::strncmp(req, path, plen) == 0 && (req[plen] == ' ' || req[plen] == '?'))
+  {
+    body = render_metrics();
+    head = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+  }
+  else
+  {
+    body = "not found\n";
+    head = "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\n";
+  }
+  head += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+  const std::string resp = head + body;
+  for (size_t off = 0; off < resp.size();)
   {
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const ssize_t n = send(fd, resp.data() + off, resp.size() - off, MSG_NOSIGNAL);
+    if (n <= 0)
+      return;
+    off += size_t(n);
   }
+}
 
-  close(fd);
-  std::lock_guard<std::mutex> lk(sinks_mu);
-  sinks.erase(std::remove(sinks.begin(), sinks.end(), fd), sinks.end());
+// The admin endpoint's thread: one connection at a time, until shutdown.
+static void run_admin(int lfd)
+{
+  while (running.load())
+  {
+    pollfd pfd[2] = {{lfd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    if (poll(pfd, 2, -1) < 0 || !(pfd[0].revents & POLLIN))
+      continue;
+    const int fd = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      continue;
+    serve_admin(fd);
+    close(fd);
+  }
+  close(lfd);
 }
 
-static int make_listener(int port)
+static int make_listener(int port, bool reuseport = false, uint32_t ip = INADDR_ANY)
 {
-  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
   if (fd < 0)
   {
     perror("socket");
@@ -162,11 +2769,16 @@ static int make_listener(int port)
 
   int yes = 1;
   setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  if (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0)
+  {
+    perror("SO_REUSEPORT");
+    std::exit(1);
+  }
 
   sockaddr_in addr{};
   addr.sin_family = AF_INET;
   addr.sin_port = htons(port);
-  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_addr.s_addr = htonl(ip);
 
   if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
   {
@@ -181,34 +2793,287 @@ static int make_listener(int port)
   return fd;
 }
 
-int main()
+static void usage(const char *argv0)
+{
+  std::cerr << "usage: " << argv0
+            << " [--reactors N] [--io epoll|uring] [--sink-queue-frames N] [--sink-queue-bytes N]\n"
+            << "       [--slow-policy disconnect|drop-oldest|drop-newest|block]\n"
+            << "       [--source-order fifo|global] [--checksum auto|scalar|sse2|avx2|avx512]\n"
+            << "       [--zerocopy-min BYTES] [--channels N] [--replay-frames N] [--replay-bytes N]\n"
+            << "       [--journal DIR] [--journal-segment BYTES] [--journal-keep N] [--admin-port PORT]\n"
+            << "  --reactors N           event loops sharing the destinations (default: one per core)\n"
+            << "  --io BACKEND           socket I/O backend (default: epoll; uring falls back to epoll)\n"
+            << "  --sink-queue-frames N  frames buffered per destination (default: 65536)\n"
+            << "  --sink-queue-bytes N   bytes buffered per destination (default: 8388608)\n"
+            << "  --slow-policy P        what a full destination queue does (default: disconnect)\n"
+            << "  --source-order O       fifo: per-source order; global: one order for all (default: fifo)\n"
+            << "  --checksum K           checksum kernel (default: auto, the widest the CPU supports)\n"
+            << "  --zerocopy-min BYTES   send frames this big with MSG_ZEROCOPY (epoll backend; default: off)\n"
+            << "  --channels N           independent feeds; channel c uses ports 33333+c and 44444+c (default: 1)\n"
+            << "  --replay-frames N      history per channel for late joiners on port 55555+c (default: 0, off)\n"
+            << "  --replay-bytes N       byte limit of that history (default: 4194304)\n"
+            << "  --journal DIR          append every delivered frame to mapped segment files in DIR\n"
+            << "  --journal-segment B    data bytes per segment, at least 1 MiB (default: 268435456)\n"
+            << "  --journal-keep N       segments kept, oldest deleted first (default: 16; 0 = all)\n"
+            << "  --admin-port PORT      serve Prometheus metrics at http://127.0.0.1:PORT/metrics (default: off)\n";
+  std::exit(2);
+}
+
+static Options parse_args(int argc, char **argv)
+{
+  Options opt;
+  for (int i = 1; i < argc; ++i)
+  {
+    const char *a = argv[i];
+    if (std::strcmp(a, "--reactors") == 0 && i + 1 < argc)
+      opt.reactors = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--io") == 0 && i + 1 < argc)
+    {
+      const char *v = argv[++i];
+      if (std::strcmp(v, "epoll") == 0)
+        opt.io = IoBackend::Epoll;
+      else if (std::strcmp(v, "uring") == 0)
+        opt.io = IoBackend::Uring;
+      else
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--sink-queue-frames") == 0 && i + 1 < argc)
+      opt.sink_max_frames = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--sink-queue-bytes") == 0 && i + 1 < argc)
+      opt.sink_max_bytes = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--slow-policy") == 0 && i + 1 < argc)
+    {
+      const char *v = argv[++i];
+      if (std::strcmp(v, "disconnect") == 0)
+        opt.slow_policy = SlowPolicy::Disconnect;
+      else if (std::strcmp(v, "drop-oldest") == 0)
+        opt.slow_policy = SlowPolicy::DropOldest;
+      else if (std::strcmp(v, "drop-newest") == 0)
+        opt.slow_policy = SlowPolicy::DropNewest;
+      else if (std::strcmp(v, "block") == 0)
+        opt.slow_policy = SlowPolicy::Block;
+      else
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--source-order") == 0 && i + 1 < argc)
+    {
+      const char *v = argv[++i];
+      if (std::strcmp(v, "fifo") == 0)
+        opt.order = SourceOrder::Fifo;
+      else if (std::strcmp(v, "global") == 0)
+        opt.order = SourceOrder::Global;
+      else
+        usage(argv[0]);
+    }
+    else if (std::strcmp(a, "--zerocopy-min") == 0 && i + 1 < argc)
+      opt.zerocopy_min = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--channels") == 0 && i + 1 < argc)
+      opt.channels = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--replay-frames") == 0 && i + 1 < argc)
+      opt.replay_frames = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--replay-bytes") == 0 && i + 1 < argc)
+      opt.replay_bytes = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--journal") == 0 && i + 1 < argc)
+      opt.journal_dir = argv[++i];
+    else if (std::strcmp(a, "--journal-segment") == 0 && i + 1 < argc)
+      opt.journal_segment = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(a, "--journal-keep") == 0 && i + 1 < argc)
+      opt.journal_keep = unsigned(std::atoi(argv[++i]));
+    else if (std::strcmp(a, "--admin-port") == 0 && i + 1 < argc)
+      opt.admin_port = std::atoi(argv[++i]);
+    else if (std::strcmp(a, "--checksum") == 0 && i + 1 < argc)
+    {
+      const char *v = argv[++i];
+      if (std::strcmp(v, "auto") == 0)
+        opt.checksum = ChecksumKernel::Auto;
+      else if (std::strcmp(v, "scalar") == 0)
+        opt.checksum = ChecksumKernel::Scalar;
+      else if (std::strcmp(v, "sse2") == 0)
+        opt.checksum = ChecksumKernel::Sse2;
+      else if (std::strcmp(v, "avx2") == 0)
+        opt.checksum = ChecksumKernel::Avx2;
+      else if (std::strcmp(v, "avx512") == 0)
+        opt.checksum = ChecksumKernel::Avx512;
+      else
+        usage(argv[0]);
+    }
+    else
+      usage(argv[0]);
+  }
+  if (opt.reactors == 0)
+    opt.reactors = std::max(1u, std::thread::hardware_concurrency());
+  if (opt.sink_max_frames == 0 || opt.sink_max_bytes < HEADER_LEN + MAX_BODY)
+    usage(argv[0]);
+  if (opt.channels == 0 || opt.channels > MAX_CHANNELS)
+    usage(argv[0]);
+  // A replay has to fit in an empty sink queue.
+  opt.replay_bytes = std::min(opt.replay_bytes, opt.sink_max_bytes);
+  if (opt.replay_frames > opt.sink_max_frames)
+    usage(argv[0]);
+  if (opt.journal_segment < (1 << 20))
+    usage(argv[0]);
+  if (opt.admin_port < 0 || opt.admin_port > 65535)
+    usage(argv[0]);
+  return opt;
+}
+
+// Give every reactor an io_uring, or none of them if any setup fails.
+static bool setup_uring()
+{
+  if (!uring_supported())
+  {
+    std::cerr << "[!] io_uring backend needs Linux 6.0+, using epoll\n";
+    return false;
+  }
+  for (auto &r : reactors)
+  {
+    r->ring = std::make_unique<Uring>();
+    if (!uring_init(*r->ring) || !uring_setup_bufs(*r->ring))
+    {
+      perror("[!] io_uring unavailable, using epoll");
+      for (auto &q : reactors)
+      {
+        if (q->ring && q->ring->fd >= 0)
+          close(q->ring->fd);
+        q->ring.reset();
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+static void setup_checksum(ChecksumKernel k)
+{
+  const ChecksumKernel best = best_checksum();
+  if (k == ChecksumKernel::Auto)
+    k = best;
+  else if (k > best)
+  {
+    std::cerr << "[!] checksum kernel not supported by this CPU, using the best available\n";
+    k = best;
+  }
+  compute_checksum = checksum_kernel(k);
+}
+
+int main(int argc, char **argv)
 {
+  options = parse_args(argc, argv);
+  const Options &opt = options;
+  setup_checksum(opt.checksum);
+
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd < 0)
+  {
+    perror("eventfd");
+    return 1;
+  }
   signal(SIGINT, handle_signal);
   signal(SIGTERM, handle_signal);
+  signal(SIGPIPE, SIG_IGN);
+  if (opt.journal_dir)
+    setup_journal();
+
+  for (unsigned i = 0; i < opt.reactors; ++i)
+  {
+    auto r = std::make_unique<Reactor>();
+    r->id = i;
+    if (opt.reactors > 1)
+    {
+      r->bcast.slots.resize(BROADCAST_SLOTS);
+      r->bcast.cursors.reset(new RingCursor[opt.reactors]);
+      for (unsigned peer = 0; peer < opt.reactors && opt.replay_frames > 0; ++peer)
+        r->bcast.cursors[peer].active.store(peer != r->id); // every history sees every frame
+    }
+    if (journal)
+      r->journal_q.slots.resize(JOURNAL_SLOTS);
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->inbox.conn.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->epfd < 0 || r->inbox.conn.fd < 0)
+    {
+      perror("reactor");
+      return 1;
+    }
+    for (unsigned c = 0; c < opt.channels; ++c)
+    {
+      auto src = std::make_unique<Listener>(Kind::SrcListener, make_listener(SOURCE_PORT + c, true));
+      auto dst = std::make_unique<Listener>(Kind::DstListener, make_listener(DEST_PORT + c, true));
+      src->channel = dst->channel = c;
+      dst->policy = opt.slow_policy;
+      r->src_accept.push_back(std::move(src));
+      r->dst_accept.push_back(std::move(dst));
+      if (opt.replay_frames > 0)
+      {
+        auto rpl = std::make_unique<Listener>(Kind::DstListener, make_listener(REPLAY_PORT + c, true));
+        rpl->channel = c;
+        rpl->policy = opt.slow_policy;
+        rpl->replay = true;
+        r->rpl_accept.push_back(std::move(rpl));
+      }
+    }
+    r->sinks.resize(opt.channels);
+    r->filters.resize(opt.channels);
+    r->history.resize(opt.replay_frames > 0 ? opt.channels : 0);
+    r->next_seq.assign(opt.channels, 0);
+    reactors.push_back(std::move(r));
+  }
+  if (opt.io == IoBackend::Uring)
+    setup_uring();
+  signal(SIGUSR1, handle_dump);
 
-  src_listener = make_listener(SOURCE_PORT);
-  dst_listener = make_listener(DEST_PORT);
+  std::thread journal_writer;
+  if (journal)
+    journal_writer = std::thread(run_journal, std::ref(*journal));
+  std::thread admin;
+  if (opt.admin_port > 0)
+    admin = std::thread(run_admin, make_listener(opt.admin_port, false, INADDR_LOOPBACK));
+  std::vector<std::thread> shards;
+  for (size_t i = 1; i < reactors.size(); ++i)
+    shards.emplace_back(run_reactor, std::ref(*reactors[i]));
+  run_reactor(*reactors[0]);
+  for (auto &t : shards)
+    t.join();
+  if (admin.joinable())
+    admin.join();
+  if (journal)
+  {
+    journal->stop.store(true);
+    uint64_t one = 1;
+    ssize_t n = write(journal->efd, &one, sizeof(one));
+    (void)n;
+    journal_writer.join();
+    uint64_t drops = 0, max_lag = 0;
+    for (auto &p : reactors)
+    {
+      drops += p->counters.journal_drops.load();
+      max_lag = std::max(max_lag, p->journal_q.max_lag);
+    }
+    std::cerr << "[*] journal: " << journal->frames << " frames, " << journal->bytes
+              << " bytes; segments " << (journal->on_disk.empty() ? 0 : journal->on_disk.front())
+              << ".." << journal->segment << "; " << drops << " dropped, max lag " << max_lag << '\n';
+    close(journal->efd);
+  }
 
-  std::thread([]
-              {
-    while (running.load()) {
-      int s = accept(src_listener, nullptr, nullptr);
-      if (s < 0) break;
-      std::thread(source_loop, s).detach();
-    } })
-      .detach();
+  for (auto &p : reactors)
+  {
+    if (p->bcast.head.load() == 0)
+      continue;
+    std::cerr << "[*] reactor " << p->id << " broadcast " << p->bcast.head.load()
+              << " frames; max reader lag:";
+    for (auto &c : reactors)
+      if (c != p)
+        std::cerr << ' ' << p->bcast.cursors[c->id].max_lag;
+    std::cerr << '\n';
+  }
 
-  while (running.load())
+  uint64_t pool_hits = 0, pool_misses = 0;
+  for (auto &p : reactors)
   {
-    int d = accept(dst_listener, nullptr, nullptr);
-    if (d < 0)
-      break;
-    std::thread(sink_loop, d).detach();
+    pool_hits += p->counters.pool_hits.load();
+    pool_misses += p->counters.pool_misses.load();
   }
+  std::cerr << "[*] frame pool: " << pool_hits << " hits, " << pool_misses << " misses\n";
 
-  if (src_listener >= 0)
-    close(src_listener);
-  if (dst_listener >= 0)
-    close(dst_listener);
+  close(wake_fd);
   return 0;
 }